@@ -16,7 +16,13 @@ layout (binding = 0) uniform Camera
     float exposure;
 }u_camera;
 
-uniform mat4 u_model;
+layout (binding = 2) uniform Object
+{
+    mat4 model;
+    mat4 modelView;
+    mat4 normal;
+    mat4 viewNormal;
+}u_object;
 
 
 out vec3 _pos;
@@ -29,20 +35,18 @@ out vec3 _wNormal;
 
 void main() {
 
-    mat4 modelView = u_camera.view * u_model;
-
-    _pos = (modelView * vec4(position, 1.0)).xyz;
+    _pos = (u_object.modelView * vec4(position, 1.0)).xyz;
 
-    _modelPos = (u_model * vec4(position, 1.0)).xyz;
+    _modelPos = (u_object.model * vec4(position, 1.0)).xyz;
 
-    _normal = normalize(mat3(transpose(inverse(modelView))) * normal);
-    _wNormal =  normalize(mat3(transpose(inverse(u_model))) * normal);
+    _normal = normalize(mat3(u_object.viewNormal) * normal);
+    _wNormal =  normalize(mat3(u_object.normal) * normal);
 
     _color = color;
 
     _uv = vec2(uv.x, 1-uv.y);
 
-    gl_Position = u_camera.viewProj  * u_model * vec4(position, 1.0);
+    gl_Position = u_camera.viewProj  * u_object.model * vec4(position, 1.0);
 
 }
 
@@ -11,11 +11,17 @@ layout (binding = 0) uniform Camera
 }u_camera;
 
 
-uniform mat4 u_model;
+layout (binding = 2) uniform Object
+{
+    mat4 model;
+    mat4 modelView;
+    mat4 normal;
+    mat4 viewNormal;
+}u_object;
 
 
 void main() {
-    gl_Position = u_camera.viewProj  * u_model * vec4(position, 1.0);
+    gl_Position = u_camera.viewProj  * u_object.model * vec4(position, 1.0);
 }
 
 #stage fragment
@@ -0,0 +1,66 @@
+// Child strands rebuilt at render time from the guide strands (see hair_loaders::ChildStrand).
+// Position p of a child is its root plus the weighted offsets of its guides up to p. A guide stops
+// contributing after its cut step, where it diverged from the others while growing.
+// Guides are read from the strand vertex storage, so include/strand-vertex.glsl has to be included before this file.
+
+struct ChildStrand
+{
+    vec3 root;
+    uint color;
+    uvec3 guides;
+    uint cuts;
+    vec4 weights;
+};
+
+layout(std430, binding = 1) readonly buffer ChildStrands
+{
+    ChildStrand children[];
+};
+
+uniform bool u_interpolated;
+uniform int u_strandLength;
+
+const uint CUT_BITS = 10u;
+const uint CUT_MASK = (1u << CUT_BITS) - 1u;
+
+vec3 child_position(ChildStrand child, int p)
+{
+    vec3 pos = child.root;
+    for (uint n = 0u; n < 3u; n++)
+    {
+        uint cut = (child.cuts >> (CUT_BITS * n)) & CUT_MASK;
+        uint guide = child.guides[n];
+        pos += child.weights[n] * (fetch_strand_position(guide + min(uint(p), cut)) - fetch_strand_position(guide));
+    }
+    return pos;
+}
+
+// Point p of a child with its direction and color
+void child_point(int child, int p, out vec3 pos, out vec3 dir, out vec3 col)
+{
+    int segments = u_strandLength - 1;
+    ChildStrand c = children[child];
+    pos = child_position(c, p);
+    // Tip keeps the direction of its last segment
+    dir = p < segments ? normalize(child_position(c, p + 1) - pos) : normalize(pos - child_position(c, p - 1));
+    col = unpackUnorm4x8(c.color).rgb;
+}
+
+// Thickness multiplier of a child, blended from those of its guides
+float child_thickness(int child)
+{
+    ChildStrand c = children[child];
+    float thickness = 0.0;
+    for (uint n = 0u; n < 3u; n++)
+        thickness += c.weights[n] * strand_thickness(strandVertices[c.guides[n]].w);
+    return thickness;
+}
+
+// Child vertex for gl_VertexID when drawing children as GL_LINES, one segment per pair of vertices
+void interpolate_child(int vertexID, out vec3 pos, out vec3 dir, out vec3 col)
+{
+    int segments = u_strandLength - 1;
+    int child = vertexID / (2 * segments);
+    int local = vertexID - child * 2 * segments;
+    child_point(child, local / 2 + (local & 1), pos, dir, col);
+}
@@ -0,0 +1,61 @@
+// Camera facing strand ribbons built in the vertex shader, pulling strands from the storage buffers, instead of
+// expanding lines in a geometry shader. include/strand-vertex.glsl and include/strand-interpolation.glsl have to be
+// included before this file.
+//
+// Strands are drawn by HairMesh as GL_TRIANGLE_STRIP, two ribbon vertices per strand vertex: gl_VertexID / 2 is the
+// strand vertex and gl_VertexID & 1 the side. Interpolated children are drawn as GL_TRIANGLES, six ribbon vertices
+// per segment, so one plain draw covers them all.
+
+struct RibbonVertex
+{
+    vec3 pos;    // Ribbon vertex, world space
+    vec3 origin; // Strand point it is expanded from, world space
+    vec3 dir;    // Strand tangent, world space
+    vec3 right;  // Across the ribbon
+    vec3 normal; // Ribbon normal, facing the camera
+    vec3 color;
+    float width; // Material thickness times the one of the strand
+    float side;  // 1 or -1 along right
+    float along; // 0 at the root, 1 at the tip
+    int id;      // Strand or child
+};
+
+// Corners of the two triangles of a child segment, in strip order: start +, end +, start -, start -, end +, end -
+const int CHILD_CORNER_END = 0x32;  // Bit per corner set at the segment end
+const int CHILD_CORNER_SIDE = 0x13; // Bit per corner set on the + side
+
+// Tangents follow the model matrix itself, its inverse transpose is only for normals
+RibbonVertex ribbon_vertex(int vertexID, mat4 model, vec3 camPos, float thickness)
+{
+    RibbonVertex r;
+    vec3 pos, dir;
+    if (u_interpolated)
+    {
+        int segments = u_strandLength - 1;
+        int child = vertexID / (6 * segments);
+        int local = vertexID - child * 6 * segments;
+        int corner = local % 6;
+        int p = local / 6 + ((CHILD_CORNER_END >> corner) & 1);
+        child_point(child, p, pos, dir, r.color);
+        r.side = ((CHILD_CORNER_SIDE >> corner) & 1) == 1 ? 1.0 : -1.0;
+        r.along = float(p) / float(segments);
+        r.id = child;
+        r.width = thickness * child_thickness(child);
+    }
+    else
+    {
+        uint strand;
+        fetch_strand_vertex(uint(vertexID) >> 1, pos, dir, r.along, strand);
+        r.color = strand_color(strand);
+        r.side = (vertexID & 1) == 0 ? 1.0 : -1.0;
+        r.id = int(strand);
+        r.width = thickness * strand_thickness(strand);
+    }
+
+    r.origin = (model * vec4(pos, 1.0)).xyz;
+    r.dir = normalize(mat3(model) * dir);
+    r.right = normalize(cross(r.dir, camPos - r.origin));
+    r.normal = normalize(cross(r.right, r.dir));
+    r.pos = r.origin + r.right * r.side * r.width * 0.5;
+    return r;
+}
@@ -0,0 +1,67 @@
+// Compact strand vertices (see StrandVertex in hair_mesh.h). Positions arrive quantized within the bounding box of their
+// strand and tangents octahedral encoded, both normalized by the vertex fetch. Per strand data comes from a storage
+// buffer indexed by the strand id attribute.
+
+struct StrandAttributes
+{
+    vec3 boxMin;
+    float thickness;
+    vec3 boxExtent;
+    uint color;
+};
+
+// Strand id of the guard vertices framing the strands. Drawn with adjacency, a neighbor with another strand id
+// (a guard or a vertex of the next strand) means the strand ends there.
+const uint STRAND_GUARD = 0xFFFFFFFFu;
+
+layout(std430, binding = 2) readonly buffer StrandAttributeBuffer
+{
+    StrandAttributes strandAttributes[];
+};
+
+vec3 strand_position(vec3 quantized, uint strand)
+{
+    return strandAttributes[strand].boxMin + quantized * strandAttributes[strand].boxExtent;
+}
+
+vec3 strand_tangent(vec2 octahedral)
+{
+    vec3 t = vec3(octahedral, 1.0 - abs(octahedral.x) - abs(octahedral.y));
+    if (t.z < 0.0)
+        t.xy = (1.0 - abs(t.yx)) * vec2(t.x >= 0.0 ? 1.0 : -1.0, t.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(t);
+}
+
+// The strand vertices themselves, for shaders that pull them by index instead of taking vertex attributes. Bound
+// without the guards (see HairMesh::bind_vertex_storage), so they are indexed as on the CPU.
+layout(std430, binding = 0) readonly buffer StrandVertices
+{
+    uvec4 strandVertices[]; // StrandVertex structs
+};
+
+vec3 fetch_strand_position(uint vertex)
+{
+    uvec4 v = strandVertices[vertex];
+    return strand_position(vec3(unpackUnorm2x16(v.x), unpackUnorm2x16(v.y).x), v.w);
+}
+
+// Decodes a strand vertex as the vertex fetch does. The parameter runs from 0 at the root to 1 at the tip
+void fetch_strand_vertex(uint vertex, out vec3 pos, out vec3 dir, out float parameter, out uint strand)
+{
+    uvec4 v = strandVertices[vertex];
+    vec2 zw = unpackUnorm2x16(v.y);
+    strand = v.w;
+    pos = strand_position(vec3(unpackUnorm2x16(v.x), zw.x), strand);
+    parameter = zw.y;
+    dir = strand_tangent(unpackSnorm2x16(v.z));
+}
+
+vec3 strand_color(uint strand)
+{
+    return unpackUnorm4x8(strandAttributes[strand].color).rgb;
+}
+
+float strand_thickness(uint strand)
+{
+    return strandAttributes[strand].thickness;
+}
@@ -1,7 +1,8 @@
 #stage vertex
 #version 460 core
 
-layout(location = 0) in vec3 position;
+layout(location = 0) in vec4 position;
+layout(location = 5) in uint strand; // Hair only
 
 layout (binding = 1) uniform Scene
 {
@@ -12,11 +13,26 @@ layout (binding = 1) uniform Scene
     mat4 lightViewProj;
 }u_scene;
 
-uniform mat4 u_model;
+layout (binding = 2) uniform Object
+{
+    mat4 model;
+    mat4 modelView;
+    mat4 normal;
+    mat4 viewNormal;
+}u_object;
+uniform bool u_isHair;
 
+#include "include/strand-vertex.glsl"
+#include "include/strand-interpolation.glsl"
 
 void main() {
-    gl_Position = u_scene.lightViewProj  * u_model * vec4(position, 1.0);
+    // Hair comes in the strand vertex format
+    vec3 pos = u_isHair ? strand_position(position.xyz, strand) : position.xyz;
+    vec3 dir, col;
+    if (u_interpolated)
+        interpolate_child(gl_VertexID, pos, dir, col);
+
+    gl_Position = u_scene.lightViewProj  * u_object.model * vec4(pos, 1.0);
 }
 
 #stage fragment
@@ -1,39 +1,10 @@
 #stage vertex
 #version 460 core
 
-layout(location = 0) in vec3 position;
-layout(location = 1) in vec3 normal;
-layout(location = 2) in vec3 tangent;
-layout(location = 3) in vec3 uv;
-layout(location = 4) in vec3 color;
-
-
-uniform mat4 u_model;
-
-out vec3 v_color;
-out vec3 v_tangent;
-
-
-void main() {
-
-    gl_Position =  u_model * vec4(position, 1.0);
-
-    v_tangent = normalize(mat3(transpose(inverse(u_model))) * tangent);
-    v_color = color;
-
-}
-
-#stage geometry
-#version 460 core
+// Ribbons expanded from the strand storage buffers, see include/strand-ribbon.glsl
 
 // #define NORMAL_MAPPING
 
-layout(lines) in;
-layout(triangle_strip, max_vertices = 4) out;
-
-in vec3 v_color[];
-in vec3 v_tangent[];
-
 layout (binding = 0) uniform Camera
 {
     mat4 viewProj;
@@ -49,67 +20,46 @@ out vec2 g_uv;
 out vec3 g_dir;
 out vec3 g_color;
 out vec3 g_origin;
+out float g_width;
 #ifdef NORMAL_MAPPING
 out mat3 g_TBN;
 #endif
 
 uniform float u_thickness;
 uniform vec3 u_camPos;
-uniform mat4 u_model;
-
-void emitQuadPoint(vec4 origin, 
-                  vec4 right,
-                  float offset,
-                  vec3 forward, 
-                  vec3 normal, 
-                  vec2 uv,
-                  int id){
-  
-        vec4 newPos = origin + right * offset; //Model space
-        gl_Position =  u_camera.viewProj * newPos;
-        g_dir = normalize(mat3(transpose(inverse(u_camera.view))) * v_tangent[id]);
-        g_color = v_color[id];
-        g_pos = (u_camera.view *  newPos).xyz;
-        g_modelPos = newPos.xyz;
-        g_uv = uv;
-        g_normal =  normalize(mat3(transpose(inverse(u_camera.view))) * normal);
-        g_origin = (u_camera.view * origin).xyz; 
-
-        //In case of normal mapping
-#ifdef NORMAL_MAPPING
-        g_TBN = mat3(right.xyz, forward, g_normal);
-#endif
+layout (binding = 2) uniform Object
+{
+    mat4 model;
+    mat4 modelView;
+    mat4 normal;
+    mat4 viewNormal;
+}u_object;
 
-        EmitVertex();
-}
+#include "include/strand-vertex.glsl"
+#include "include/strand-interpolation.glsl"
+#include "include/strand-ribbon.glsl"
 
 void main() {
-  
-        //Model space --->>>
-
-        vec4 startPoint = gl_in[0].gl_Position;
-        vec4 endPoint = gl_in[1].gl_Position;
 
-        vec4 view0 = vec4(u_camPos,1.0)-startPoint;
-        vec4 view1 = vec4(u_camPos,1.0)-endPoint;
-
-        vec3 dir0 = v_tangent[0];
-        vec3 dir1 = v_tangent[1];
-
-        vec4 right0 = normalize(vec4(cross(dir0.xyz,view0.xyz),0.0));
-        vec4 right1 = normalize(vec4(cross(dir1.xyz,view1.xyz),0.0));
-
-        vec3 normal0 = normalize(cross(right0.xyz,dir0.xyz));
-        vec3 normal1 = normalize(cross(right1.xyz,dir1.xyz));
+        //Model space --->>>
 
-        //<<<----
+        RibbonVertex ribbon = ribbon_vertex(gl_VertexID, u_object.model, u_camPos, u_thickness);
+        mat3 viewNormal = mat3(u_camera.view); // Rigid, its own normal matrix
 
-        float halfLength = u_thickness*0.5;
+        gl_Position =  u_camera.viewProj * vec4(ribbon.pos, 1.0);
+        g_dir = normalize(viewNormal * ribbon.dir);
+        g_color = ribbon.color;
+        g_pos = (u_camera.view * vec4(ribbon.pos, 1.0)).xyz;
+        g_modelPos = ribbon.pos;
+        g_uv = vec2(ribbon.side, ribbon.along);
+        g_normal =  normalize(viewNormal * ribbon.normal);
+        g_origin = (u_camera.view * vec4(ribbon.origin, 1.0)).xyz;
+        g_width = ribbon.width;
 
-        emitQuadPoint(startPoint,right0,halfLength,dir0,normal0,vec2(1.0,0.0),0);
-        emitQuadPoint(endPoint,right1,halfLength,dir1,normal1,vec2(1.0,1.0),1);
-        emitQuadPoint(startPoint,-right0,halfLength,dir0,normal0,vec2(-1.0,0.0),0);
-        emitQuadPoint(endPoint,-right1,halfLength,dir1,normal1,vec2(-1.0,1.0),1);
+        //In case of normal mapping
+#ifdef NORMAL_MAPPING
+        g_TBN = mat3(ribbon.right, ribbon.dir, g_normal);
+#endif
 
 }
 
@@ -126,6 +76,7 @@ in vec3 g_normal;
 in vec2 g_uv;
 in vec3 g_dir;
 in vec3 g_origin;
+in float g_width;
 #ifdef NORMAL_MAPPING
 in mat3 g_TBN;
 #endif
@@ -162,7 +113,6 @@ uniform vec3 u_spec1;
 uniform vec3 u_spec2;
 uniform float u_specPwr1;
 uniform float u_specPwr2;
-uniform float u_thickness;
 #ifdef NORMAL_MAPPING
 uniform sampler2D u_normalText;
 #endif
@@ -170,7 +120,6 @@ uniform sampler2D u_normalText;
 uniform sampler2D u_shadowMap;
 
 vec3 sh_normal;
-float halfLength = u_thickness*0.5f;
 
 //Constant
 const float PI = 3.14159265359;
@@ -184,6 +133,7 @@ float computePointInCircleSurface(float u,float radius) {
 }
 
 void computeShadingNormal(){
+    float halfLength = g_width*0.5f;
     float offsetMag = computePointInCircleSurface(g_uv.x,halfLength);
     vec3 offsetPos = g_pos + g_normal * (halfLength/offsetMag);
     
@@ -1,11 +1,10 @@
 #stage vertex
 #version 460 core
 
-layout(location = 0) in vec3 position;
-layout(location = 1) in vec3 normal;
-layout(location = 2) in vec3 tangent;
-layout(location = 3) in vec3 uv;
-layout(location = 4) in vec3 color;
+// Strand vertex format, decoded with include/strand-vertex.glsl
+layout(location = 0) in vec4 position;
+layout(location = 2) in vec2 tangent;
+layout(location = 5) in uint strand;
 
 
 layout (binding = 0) uniform Camera
@@ -18,22 +17,37 @@ layout (binding = 0) uniform Camera
 
 }u_camera;
 
-uniform mat4 u_model;
+layout (binding = 2) uniform Object
+{
+    mat4 model;
+    mat4 modelView;
+    mat4 normal;
+    mat4 viewNormal;
+}u_object;
 
 out vec3 v_color;
 out vec3 v_dir;
 out int v_id;
 out vec3 v_pos;
 
+#include "include/strand-vertex.glsl"
+#include "include/strand-interpolation.glsl"
+
 void main() {
 
-    gl_Position =  u_camera.viewProj * u_model * vec4(position, 1.0);
+    vec3 pos = strand_position(position.xyz, strand);
+    vec3 dir = strand_tangent(tangent);
+    vec3 col = strand_color(strand);
+    if (u_interpolated)
+        interpolate_child(gl_VertexID, pos, dir, col);
+
+    gl_Position =  u_camera.viewProj * u_object.model * vec4(pos, 1.0);
 
-    v_dir = normalize(mat3(transpose(inverse(u_model))) * tangent);
-    v_dir = tangent;
-    v_color = color;
+    v_dir = normalize(mat3(u_object.model) * dir);
+    v_dir = dir;
+    v_color = col;
     v_id = gl_VertexID;
-    v_pos = (u_model * vec4(position, 1.0)).xyz;
+    v_pos = (u_object.model * vec4(pos, 1.0)).xyz;
 
 }
 
@@ -12,18 +12,24 @@ layout (binding = 0) uniform Camera
     mat4 view;
 }u_camera;
 
-uniform mat4 u_model;
+layout (binding = 2) uniform Object
+{
+    mat4 model;
+    mat4 modelView;
+    mat4 normal;
+    mat4 viewNormal;
+}u_object;
 
 out vec3 _pos;
 out vec3 _color;
 
 void main() {
     
-    _pos = (u_camera.modelView * vec4(position, 1.0)).xyz;
+    _pos = (u_object.modelView * vec4(position, 1.0)).xyz;
 
     _color = color;
 
-    gl_Position = u_camera.viewProj  * u_model * vec4(position, 1.0);
+    gl_Position = u_camera.viewProj  * u_object.model * vec4(position, 1.0);
 
 }
 
@@ -0,0 +1,178 @@
+#include "asset_loader.h"
+#include "loaders.h"
+
+GLIB_NAMESPACE_BEGIN
+
+AssetLoader::AssetLoader(unsigned int workers)
+{
+    for (unsigned int i = 0; i < std::max(1u, workers); i++)
+        m_workers.emplace_back(&AssetLoader::worker_loop, this);
+}
+
+void AssetLoader::worker_loop()
+{
+    for (;;)
+    {
+        Handle job;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [this]
+                             { return m_stop || !m_queued.empty(); });
+            if (m_stop)
+                return;
+            job = std::move(m_queued.front());
+            m_queued.pop_front();
+        }
+
+        job->state = LoadState::LOADING;
+        bool loaded = false;
+        try
+        {
+            loaded = job->load ? job->load() : true;
+        }
+        catch (const std::exception &e)
+        {
+            ERR_LOG("Caught exception loading " << job->name << ": " << e.what());
+        }
+
+        job->state = loaded ? LoadState::UPLOADING : LoadState::FAILED;
+        m_completed.push(std::move(job));
+    }
+}
+
+AssetLoader::Handle AssetLoader::submit(const std::string &name, std::function<bool()> load, std::function<void()> upload, std::function<void(bool)> onComplete)
+{
+    Handle job = std::make_shared<Job>();
+    job->name = name;
+    job->load = std::move(load);
+    job->upload = std::move(upload);
+    job->onComplete = std::move(onComplete);
+    m_jobs.push_back(job);
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queued.push_back(job);
+    }
+    m_condition.notify_one();
+
+    return job;
+}
+
+AssetLoader::Handle AssetLoader::load_mesh(Mesh *const mesh, const std::string &name, std::function<bool(Mesh *const)> loader, std::function<void(bool)> onComplete)
+{
+    auto staging = std::make_shared<Mesh>();
+    return submit(
+        name, [staging, loader]
+        { return loader(staging.get()) && staging->is_geometry_loaded(); },
+        [mesh, staging]
+        {
+            mesh->take_geometry_from(staging.get());
+            mesh->generate_buffers();
+        },
+        std::move(onComplete));
+}
+
+AssetLoader::Handle AssetLoader::load_hair(HairMesh *const mesh, const std::string &name, std::function<bool(HairMesh *const)> loader, std::function<void(bool)> onComplete)
+{
+    if (mesh->is_streaming())
+        return submit(
+            name, [mesh, loader]
+            { return loader(mesh); },
+            nullptr, std::move(onComplete));
+
+    auto staging = std::make_shared<HairMesh>();
+    return submit(
+        name, [staging, loader]
+        { return loader(staging.get()) && staging->is_geometry_loaded(); },
+        [mesh, staging]
+        {
+            mesh->take_geometry_from(staging.get());
+            mesh->generate_buffers();
+        },
+        std::move(onComplete));
+}
+
+AssetLoader::Handle AssetLoader::load_texture(Texture *const texture, const char *fileName, bool isPanorama, std::function<void(bool)> onComplete)
+{
+    auto staging = std::make_shared<Texture>(texture->get_extent(), texture->get_config());
+    std::string path(fileName);
+    return submit(
+        path, [staging, path, isPanorama]
+        {
+            loaders::load_image(staging.get(), path.c_str(), isPanorama);
+            Image img = staging->get_image();
+            return img.data != nullptr || img.HDRdata != nullptr; },
+        [texture, staging, isPanorama]
+        {
+            Image img = staging->get_image();
+            texture->set_image(img);
+            if (!isPanorama)
+                texture->set_extent(img.extent);
+            texture->generate();
+        },
+        std::move(onComplete));
+}
+
+void AssetLoader::process_completed()
+{
+    m_completed.drain([](Handle &job)
+                      {
+        const bool loaded = job->state == LoadState::UPLOADING;
+        if (loaded && job->upload)
+            job->upload();
+        job->state = loaded ? LoadState::READY : LoadState::FAILED;
+
+        if (job->onComplete)
+            job->onComplete(loaded);
+
+        // Only the state is kept around for the UI, free the staging data
+        job->load = nullptr;
+        job->upload = nullptr;
+        job->onComplete = nullptr; });
+}
+
+void AssetLoader::shutdown()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+        m_queued.clear();
+    }
+    m_condition.notify_all();
+
+    for (std::thread &worker : m_workers)
+        if (worker.joinable())
+            worker.join();
+    m_workers.clear();
+}
+
+bool AssetLoader::is_idle() const
+{
+    for (const Handle &job : m_jobs)
+    {
+        const LoadState state = job->state;
+        if (state != LoadState::READY && state != LoadState::FAILED)
+            return false;
+    }
+    return true;
+}
+
+const char *AssetLoader::get_state_name(LoadState state)
+{
+    switch (state)
+    {
+    case LoadState::QUEUED:
+        return "Queued";
+    case LoadState::LOADING:
+        return "Loading";
+    case LoadState::UPLOADING:
+        return "Uploading";
+    case LoadState::READY:
+        return "Ready";
+    case LoadState::FAILED:
+        return "Failed";
+    }
+    return "";
+}
+
+GLIB_NAMESPACE_END
@@ -0,0 +1,105 @@
+#ifndef __ASSET_LOADER__
+#define __ASSET_LOADER__
+
+#include <string>
+#include <memory>
+#include <vector>
+#include <thread>
+#include <condition_variable>
+#include "mesh.h"
+#include "hair_mesh.h"
+#include "texture.h"
+#include "utils.h"
+
+GLIB_NAMESPACE_BEGIN
+
+enum class LoadState
+{
+    QUEUED,
+    LOADING,
+    UPLOADING,
+    READY,
+    FAILED
+};
+
+/*
+Asynchronous asset loading service. Jobs run their load step on a worker thread and are then handed to
+the GL thread through a lock free completion queue. There, process_completed() runs the upload step
+(the only place where GL resources are created) followed by the completion callback.
+*/
+class AssetLoader
+{
+public:
+    struct Job
+    {
+        std::string name;
+        std::atomic<LoadState> state{LoadState::QUEUED};
+
+        std::function<bool()> load;                // Worker thread. Returns false on failure
+        std::function<void()> upload;              // GL thread
+        std::function<void(bool)> onComplete;      // GL thread, receives whether the job succeeded
+    };
+    using Handle = std::shared_ptr<Job>;
+
+private:
+    std::vector<std::thread> m_workers;
+    std::deque<Handle> m_queued;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    bool m_stop{false};
+
+    utils::LockFreeQueue<Handle> m_completed;
+
+    std::vector<Handle> m_jobs; // GL thread only, kept for the UI
+
+    void worker_loop();
+
+public:
+    AssetLoader(unsigned int workers = 2);
+    ~AssetLoader() { shutdown(); }
+
+    AssetLoader(const AssetLoader &) = delete;
+    AssetLoader &operator=(const AssetLoader &) = delete;
+
+    /*
+    GL thread. Queues a generic job.
+    */
+    Handle submit(const std::string &name, std::function<bool()> load, std::function<void()> upload = nullptr, std::function<void(bool)> onComplete = nullptr);
+
+    /*
+    GL thread. Runs loader on a staging mesh and moves the result into mesh and creates its buffers on the GL thread.
+    */
+    Handle load_mesh(Mesh *const mesh, const std::string &name, std::function<bool(Mesh *const)> loader, std::function<void(bool)> onComplete = nullptr);
+
+    /*
+    GL thread. Same as load_mesh, for hair meshes.
+    Streaming meshes are loaded in place instead, as they are only fed through their thread safe batch queue.
+    loader returns whether it succeeded, which is all a streaming load can go by.
+    */
+    Handle load_hair(HairMesh *const mesh, const std::string &name, std::function<bool(HairMesh *const)> loader, std::function<void(bool)> onComplete = nullptr);
+
+    /*
+    GL thread. Decodes the image off-thread and generates the texture on the GL thread.
+    */
+    Handle load_texture(Texture *const texture, const char *fileName, bool isPanorama = false, std::function<void(bool)> onComplete = nullptr);
+
+    /*
+    GL thread, call once per frame. Uploads finished jobs and fires their callbacks.
+    */
+    void process_completed();
+
+    /*
+    Waits for the jobs being loaded and stops the workers. Queued jobs are dropped.
+    */
+    void shutdown();
+
+    inline const std::vector<Handle> &get_jobs() const { return m_jobs; }
+
+    bool is_idle() const;
+
+    static const char *get_state_name(LoadState state);
+};
+
+GLIB_NAMESPACE_END
+
+#endif
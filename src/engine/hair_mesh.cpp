@@ -0,0 +1,520 @@
+#include <algorithm>
+#include <cstddef>
+#include <glm/gtc/packing.hpp>
+#include "hair_mesh.h"
+
+GLIB_NAMESPACE_BEGIN
+
+namespace
+{
+    // Guards needed for the strand vertices to start at a valid storage buffer offset
+    size_t leading_guard_vertices()
+    {
+        GLint alignment = 0;
+        GL_CHECK(glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment));
+        return std::max<size_t>(alignment, sizeof(StrandVertex)) / sizeof(StrandVertex);
+    }
+}
+
+HairGeometry HairGeometry::extract(size_t strandStart, size_t strandEnd) const
+{
+    HairGeometry batch;
+    if (strandStart >= strandEnd)
+        return batch;
+
+    const size_t vertexStart = strands.first[strandStart];
+    const size_t vertexEnd = strands.first[strandEnd - 1] + strands.count[strandEnd - 1];
+
+    batch.positions.assign(positions.begin() + vertexStart, positions.begin() + vertexEnd);
+    batch.tangents.assign(tangents.begin() + vertexStart, tangents.begin() + vertexEnd);
+    batch.strands.first.reserve(strandEnd - strandStart);
+    for (size_t s = strandStart; s < strandEnd; s++)
+        batch.strands.first.push_back(strands.first[s] - static_cast<int>(vertexStart));
+    batch.strands.count.assign(strands.count.begin() + strandStart, strands.count.begin() + strandEnd);
+    batch.colors.assign(colors.begin() + strandStart, colors.begin() + strandEnd);
+    batch.thickness.assign(thickness.begin() + strandStart, thickness.begin() + strandEnd);
+    return batch;
+}
+
+void HairGeometry::append(const HairGeometry &other)
+{
+    // Strands are back to back, so the table knows where the vertices end even without them
+    const int base = strands.empty() ? 0 : strands.first.back() + strands.count.back();
+    positions.insert(positions.end(), other.positions.begin(), other.positions.end());
+    tangents.insert(tangents.end(), other.tangents.begin(), other.tangents.end());
+    for (int first : other.strands.first)
+        strands.first.push_back(first + base);
+    strands.count.insert(strands.count.end(), other.strands.count.begin(), other.strands.count.end());
+    colors.insert(colors.end(), other.colors.begin(), other.colors.end());
+    thickness.insert(thickness.end(), other.thickness.begin(), other.thickness.end());
+}
+
+void HairGeometry::permute_strands(const std::vector<uint32_t> &order)
+{
+    HairGeometry sorted;
+    sorted.strands.resize(order.size());
+    int vertices = 0;
+    for (size_t s = 0; s < order.size(); s++)
+    {
+        sorted.strands.first[s] = vertices;
+        sorted.strands.count[s] = strands.count[order[s]];
+        vertices += sorted.strands.count[s];
+    }
+    sorted.positions.resize(vertices);
+    sorted.tangents.resize(vertices);
+    sorted.colors.resize(order.size());
+    sorted.thickness.resize(order.size());
+
+    utils::parallel_for(0, order.size(), [&](size_t s)
+                        {
+        const size_t from = strands.first[order[s]];
+        const size_t to = sorted.strands.first[s];
+        std::copy_n(positions.begin() + from, sorted.strands.count[s], sorted.positions.begin() + to);
+        std::copy_n(tangents.begin() + from, sorted.strands.count[s], sorted.tangents.begin() + to);
+        sorted.colors[s] = colors[order[s]];
+        sorted.thickness[s] = thickness[order[s]]; },
+                        256);
+    *this = std::move(sorted);
+}
+
+void HairGeometry::sort_strands_by_root()
+{
+    std::vector<glm::vec3> roots(strand_count());
+    for (size_t s = 0; s < roots.size(); s++)
+        roots[s] = positions[strands.first[s]];
+    permute_strands(utils::morton_order(roots));
+}
+
+void HairGeometry::release_attributes()
+{
+    positions = {};
+    tangents = {};
+    colors = {};
+    thickness = {};
+}
+
+Sphere HairGeometry::compute_bounding_sphere() const
+{
+    if (positions.empty())
+        return Sphere();
+
+    glm::vec3 minCoords = positions.front();
+    glm::vec3 maxCoords = positions.front();
+    for (const glm::vec3 &p : positions)
+    {
+        minCoords = glm::min(minCoords, p);
+        maxCoords = glm::max(maxCoords, p);
+    }
+    return Sphere((maxCoords + minCoords) * 0.5f, glm::length((maxCoords - minCoords) * 0.5f));
+}
+
+void HairMesh::set_geometry(HairGeometry &&g)
+{
+    m_hairGeometry = std::move(g);
+    m_geometry_loaded = true;
+    m_geometry_released = false;
+    m_storageRanges = DrawRanges{};
+    m_lodRanges = DrawRanges{};
+}
+
+void HairMesh::take_geometry_from(HairMesh *const source)
+{
+    if (!source->m_geometry_loaded)
+        return;
+
+    set_geometry(std::move(source->m_hairGeometry));
+    source->m_hairGeometry = HairGeometry{};
+    source->m_geometry_loaded = false;
+
+    if (source->m_bv)
+    {
+        set_bounding_volume(source->m_bv);
+        source->m_bv = nullptr;
+    }
+}
+
+void HairMesh::pack_strands(const HairGeometry &g, size_t strandStart, size_t strandEnd, size_t strandOffset,
+                            std::vector<StrandVertex> &vertices, std::vector<StrandAttributes> &attributes)
+{
+    vertices.clear();
+    attributes.clear();
+    if (strandStart >= strandEnd)
+        return;
+
+    const size_t vertexStart = g.strands.first[strandStart];
+    const size_t vertexEnd = g.strands.first[strandEnd - 1] + g.strands.count[strandEnd - 1];
+    vertices.resize(vertexEnd - vertexStart);
+    attributes.resize(strandEnd - strandStart);
+
+    auto unorm16 = [](float v)
+    { return static_cast<uint16_t>(std::round(glm::clamp(v, 0.0f, 1.0f) * 65535.0f)); };
+    auto snorm16 = [](float v)
+    { return static_cast<int16_t>(std::round(glm::clamp(v, -1.0f, 1.0f) * 32767.0f)); };
+
+    utils::parallel_for_range(strandStart, strandEnd, [&](size_t start, size_t end)
+                              {
+        for (size_t s = start; s < end; s++)
+        {
+            const size_t first = g.strands.first[s];
+            const size_t count = g.strands.count[s];
+
+            glm::vec3 boxMin = g.positions[first];
+            glm::vec3 boxMax = boxMin;
+            for (size_t v = first + 1; v < first + count; v++)
+            {
+                boxMin = glm::min(boxMin, g.positions[v]);
+                boxMax = glm::max(boxMax, g.positions[v]);
+            }
+            const glm::vec3 extent = boxMax - boxMin;
+            const glm::vec3 scale = {extent.x > 0.0f ? 1.0f / extent.x : 0.0f,
+                                     extent.y > 0.0f ? 1.0f / extent.y : 0.0f,
+                                     extent.z > 0.0f ? 1.0f / extent.z : 0.0f};
+
+            attributes[s - strandStart] = {boxMin, g.thickness[s], extent, glm::packUnorm4x8(glm::vec4(g.colors[s], 1.0f))};
+
+            for (size_t i = 0; i < count; i++)
+            {
+                StrandVertex &packed = vertices[first + i - vertexStart];
+
+                const glm::vec3 q = (g.positions[first + i] - boxMin) * scale;
+                packed.position[0] = unorm16(q.x);
+                packed.position[1] = unorm16(q.y);
+                packed.position[2] = unorm16(q.z);
+                packed.parameter = unorm16(count > 1 ? float(i) / float(count - 1) : 0.0f);
+
+                // Octahedral mapping: project on the octahedron and fold the lower half over the upper one
+                const glm::vec3 t = g.tangents[first + i];
+                const float l1 = std::abs(t.x) + std::abs(t.y) + std::abs(t.z);
+                glm::vec2 oct = l1 > 0.0f ? glm::vec2(t.x, t.y) / l1 : glm::vec2(0.0f);
+                if (t.z < 0.0f)
+                    oct = (1.0f - glm::abs(glm::vec2(oct.y, oct.x))) * glm::vec2(oct.x >= 0.0f ? 1.0f : -1.0f, oct.y >= 0.0f ? 1.0f : -1.0f);
+                packed.tangent[0] = snorm16(oct.x);
+                packed.tangent[1] = snorm16(oct.y);
+
+                packed.strand = static_cast<uint32_t>(strandOffset + s - strandStart);
+            }
+        } });
+}
+
+void HairMesh::unpack_strands(const std::vector<StrandVertex> &vertices, const std::vector<StrandAttributes> &attributes, HairGeometry &g)
+{
+    g.positions.resize(vertices.size());
+    g.tangents.resize(vertices.size());
+    g.colors.resize(attributes.size());
+    g.thickness.resize(attributes.size());
+
+    for (size_t s = 0; s < attributes.size(); s++)
+    {
+        g.colors[s] = glm::vec3(glm::unpackUnorm4x8(attributes[s].color));
+        g.thickness[s] = attributes[s].thickness;
+    }
+
+    utils::parallel_for(0, vertices.size(), [&](size_t v)
+                        {
+        const StrandVertex &packed = vertices[v];
+        const StrandAttributes &strand = attributes[packed.strand];
+
+        const glm::vec3 q = glm::vec3(packed.position[0], packed.position[1], packed.position[2]) / 65535.0f;
+        g.positions[v] = strand.boxMin + q * strand.boxExtent;
+
+        // Unfold the lower half of the octahedron
+        glm::vec2 oct = glm::max(glm::vec2(packed.tangent[0], packed.tangent[1]) / 32767.0f, glm::vec2(-1.0f));
+        glm::vec3 t = {oct.x, oct.y, 1.0f - std::abs(oct.x) - std::abs(oct.y)};
+        if (t.z < 0.0f)
+            oct = (1.0f - glm::abs(glm::vec2(oct.y, oct.x))) * glm::vec2(oct.x >= 0.0f ? 1.0f : -1.0f, oct.y >= 0.0f ? 1.0f : -1.0f);
+        t.x = oct.x;
+        t.y = oct.y;
+        g.tangents[v] = glm::length(t) > 0.0f ? glm::normalize(t) : t; },
+                        4096);
+}
+
+void HairMesh::generate_buffers()
+{
+    if (!m_geometry_loaded || m_stream.enabled)
+        return;
+
+    std::vector<StrandVertex> vertices;
+    std::vector<StrandAttributes> attributes;
+    pack_strands(m_hairGeometry, 0, m_hairGeometry.strand_count(), 0, vertices, attributes);
+
+    m_guardVertices = leading_guard_vertices();
+
+    GL_CHECK(glGenVertexArrays(1, &m_vao));
+    GL_CHECK(glBindVertexArray(m_vao));
+
+    GL_CHECK(glGenBuffers(1, &m_vbo));
+    GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, m_vbo));
+    GL_CHECK(glBufferData(GL_ARRAY_BUFFER, sizeof(StrandVertex) * (m_guardVertices + vertices.size() + 1), nullptr, GL_STATIC_DRAW));
+    GL_CHECK(glBufferSubData(GL_ARRAY_BUFFER, sizeof(StrandVertex) * m_guardVertices, sizeof(StrandVertex) * vertices.size(), vertices.data()));
+
+    setup_vertex_attributes();
+
+    GL_CHECK(glBindVertexArray(0));
+
+    write_guards(0, m_guardVertices);
+    write_guards(m_guardVertices + vertices.size(), 1);
+
+    GL_CHECK(glGenBuffers(1, &m_strandBuffer));
+    GL_CHECK(glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_strandBuffer));
+    GL_CHECK(glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(StrandAttributes) * attributes.size(), attributes.data(), GL_STATIC_DRAW));
+    GL_CHECK(glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0));
+
+    m_buffer_loaded = true;
+    m_vertexCount = m_hairGeometry.vertex_count();
+
+    release_geometry();
+}
+
+void HairMesh::release_geometry()
+{
+    if (m_residency != GeometryResidency::RELEASE_AFTER_UPLOAD)
+        return;
+
+    if (!m_bv)
+        set_bounding_volume(new Sphere(m_hairGeometry.compute_bounding_sphere()));
+
+    m_hairGeometry.release_attributes();
+    m_geometry_released = true;
+}
+
+void HairMesh::read_back_geometry()
+{
+    if (!m_geometry_released || !m_buffer_loaded)
+        return;
+
+    std::vector<StrandVertex> vertices(m_vertexCount);
+    std::vector<StrandAttributes> attributes(m_hairGeometry.strand_count());
+    GL_CHECK(glBindBuffer(GL_COPY_READ_BUFFER, m_vbo));
+    GL_CHECK(glGetBufferSubData(GL_COPY_READ_BUFFER, m_guardVertices * sizeof(StrandVertex), vertices.size() * sizeof(StrandVertex), vertices.data()));
+    GL_CHECK(glBindBuffer(GL_COPY_READ_BUFFER, m_strandBuffer));
+    GL_CHECK(glGetBufferSubData(GL_COPY_READ_BUFFER, 0, attributes.size() * sizeof(StrandAttributes), attributes.data()));
+    GL_CHECK(glBindBuffer(GL_COPY_READ_BUFFER, 0));
+
+    unpack_strands(vertices, attributes, m_hairGeometry);
+    m_geometry_released = false;
+}
+
+void HairMesh::write_guards(size_t vertex, size_t count)
+{
+    StrandVertex guard{};
+    guard.strand = StrandVertex::GUARD;
+    const std::vector<StrandVertex> guards(count, guard);
+    GL_CHECK(glBindBuffer(GL_COPY_WRITE_BUFFER, m_vbo));
+    GL_CHECK(glBufferSubData(GL_COPY_WRITE_BUFFER, vertex * sizeof(StrandVertex), count * sizeof(StrandVertex), guards.data()));
+    GL_CHECK(glBindBuffer(GL_COPY_WRITE_BUFFER, 0));
+}
+
+void HairMesh::setup_vertex_attributes()
+{
+    const size_t vertexSize = sizeof(StrandVertex);
+
+    // Quantized position, plus the parameter along the strand in w
+    GL_CHECK(glVertexAttribPointer(0, 4, GL_UNSIGNED_SHORT, GL_TRUE, vertexSize, (void *)offsetof(StrandVertex, position)));
+    GL_CHECK(glEnableVertexAttribArray(0));
+    // Octahedral tangent
+    GL_CHECK(glVertexAttribPointer(2, 2, GL_SHORT, GL_TRUE, vertexSize, (void *)offsetof(StrandVertex, tangent)));
+    GL_CHECK(glEnableVertexAttribArray(2));
+    // Strand id
+    GL_CHECK(glVertexAttribIPointer(5, 1, GL_UNSIGNED_INT, vertexSize, (void *)offsetof(StrandVertex, strand)));
+    GL_CHECK(glEnableVertexAttribArray(5));
+}
+
+#pragma region STREAMING
+
+void HairMesh::reserve_stream_buffers(size_t vertices, size_t strands)
+{
+    GL_CHECK(glBindVertexArray(m_vao));
+
+    // Room for the guards on both sides
+    if (grow_buffer(m_vbo, m_stream.vertexCapacity, m_guardVertices + vertices + 1, (m_guardVertices + m_vertexCount) * sizeof(StrandVertex), sizeof(StrandVertex)))
+    {
+        GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, m_vbo));
+        setup_vertex_attributes();
+    }
+    grow_buffer(m_strandBuffer, m_hairStream.strandCapacity, strands, m_hairGeometry.strand_count() * sizeof(StrandAttributes), sizeof(StrandAttributes));
+
+    GL_CHECK(glBindVertexArray(0));
+}
+
+void HairMesh::upload_streamed_batches()
+{
+    if (!m_stream.enabled)
+        return;
+
+    Mesh::upload_streamed_batches();
+
+    if (!m_buffer_loaded)
+    {
+        m_guardVertices = leading_guard_vertices();
+        GL_CHECK(glGenVertexArrays(1, &m_vao));
+        reserve_stream_buffers(m_stream.vertexCapacity, m_hairStream.strandCapacity);
+        write_guards(0, m_guardVertices + 1);
+        m_buffer_loaded = true;
+    }
+
+    HairGeometry &batch = m_hairStream.current;
+    size_t budget = m_stream.uploadBudget;
+
+    while (budget > 0)
+    {
+        if (batch.positions.empty())
+        {
+            if (!m_hairStream.pending.try_pop(batch))
+                break;
+
+            m_stream.uploadedVertices = 0;
+            reserve_stream_buffers(m_vertexCount + batch.vertex_count(), m_hairGeometry.strand_count() + batch.strand_count());
+
+            // Strand attributes are small, they go up whole with the first slice of the batch
+            std::vector<StrandAttributes> attributes;
+            pack_strands(batch, 0, batch.strand_count(), m_hairGeometry.strand_count(), m_hairStream.packedVertices, attributes);
+            GL_CHECK(glBindBuffer(GL_COPY_WRITE_BUFFER, m_strandBuffer));
+            GL_CHECK(glBufferSubData(GL_COPY_WRITE_BUFFER, m_hairGeometry.strand_count() * sizeof(StrandAttributes), attributes.size() * sizeof(StrandAttributes), attributes.data()));
+            GL_CHECK(glBindBuffer(GL_COPY_WRITE_BUFFER, 0));
+            budget -= std::min(budget, attributes.size() * sizeof(StrandAttributes));
+        }
+
+        // Upload the next slice of the batch. A slice always moves at least one vertex forward
+        if (m_stream.uploadedVertices < batch.vertex_count())
+        {
+            const size_t count = std::min(batch.vertex_count() - m_stream.uploadedVertices, std::max<size_t>(budget / sizeof(StrandVertex), 1));
+            const size_t offset = m_guardVertices + m_vertexCount + m_stream.uploadedVertices;
+            GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, m_vbo));
+            GL_CHECK(glBufferSubData(GL_ARRAY_BUFFER, offset * sizeof(StrandVertex), count * sizeof(StrandVertex), m_hairStream.packedVertices.data() + m_stream.uploadedVertices));
+            GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, 0));
+            m_stream.uploadedVertices += count;
+            budget -= std::min(budget, count * sizeof(StrandVertex));
+        }
+
+        // Batch fully on the GPU, its strands become drawable
+        if (m_stream.uploadedVertices == batch.vertex_count())
+        {
+            m_vertexCount += batch.vertex_count();
+            write_guards(m_guardVertices + m_vertexCount, 1);
+            if (m_residency == GeometryResidency::RELEASE_AFTER_UPLOAD)
+            {
+                m_hairGeometry.release_attributes();
+                batch.release_attributes();
+                m_geometry_released = true;
+            }
+            if (m_hairGeometry.strands.empty())
+                m_hairGeometry = std::move(batch);
+            else
+                m_hairGeometry.append(batch);
+            m_geometry_loaded = true;
+            batch = HairGeometry{};
+            m_hairStream.packedVertices.clear();
+        }
+    }
+}
+
+#pragma endregion
+
+void HairMesh::draw_strands(size_t strandCount, bool useMaterial, unsigned int drawingPrimitive)
+{
+    if (!m_enabled)
+        return;
+    if (!m_buffer_loaded)
+    {
+        generate_buffers();
+        return;
+    }
+
+    if (m_material && useMaterial)
+    {
+        m_material->bind();
+    }
+
+    const bool adjacency = drawingPrimitive == GL_LINE_STRIP_ADJACENCY;
+    const DrawRanges &ranges = update_draw_ranges(strandCount, adjacency);
+    const GLsizei drawCount = static_cast<GLsizei>(std::min(strandCount, ranges.strips.size()));
+    if (drawingPrimitive == GL_TRIANGLE_STRIP)
+    {
+        // Vertices are pulled from storage, nothing to fetch
+        bind_empty_vertex_array();
+        GL_CHECK(glMultiDrawArrays(GL_TRIANGLE_STRIP, ranges.ribbons.first.data(), ranges.ribbons.count.data(), drawCount));
+    }
+    else
+    {
+        const StrandTable &lines = adjacency ? ranges.adjacency : ranges.strips;
+        GL_CHECK(glBindVertexArray(m_vao));
+        GL_CHECK(glMultiDrawArrays(adjacency ? GL_LINE_STRIP_ADJACENCY : GL_LINE_STRIP, lines.first.data(), lines.count.data(), drawCount));
+    }
+    GL_CHECK(glBindVertexArray(0));
+
+    if (m_material && useMaterial)
+    {
+        m_material->unbind();
+    }
+}
+
+const HairMesh::DrawRanges &HairMesh::update_draw_ranges(size_t strandCount, bool adjacency)
+{
+    const StrandTable &strands = m_hairGeometry.strands;
+    const size_t n = strands.size();
+    const int guards = static_cast<int>(m_guardVertices);
+
+    // Strands only ever arrive at the end of the storage order
+    for (size_t s = m_storageRanges.strips.size(); s < n; s++)
+    {
+        m_storageRanges.strips.push_back(strands.first[s] + guards, strands.count[s]);
+        m_storageRanges.ribbons.push_back(2 * strands.first[s], 2 * strands.count[s]);
+    }
+
+    DrawRanges &ranges = strandCount >= n ? m_storageRanges : m_lodRanges;
+    if (&ranges == &m_lodRanges && m_lodRanges.strips.size() != n)
+    {
+        // New strands interleave with the old ones in LOD order, so the tables are rebuilt whenever strands arrive.
+        // Walking every cluster index of the next power of two in bit reversed order lists the clusters sorted by
+        // their reversed index in linear time
+        m_lodRanges = DrawRanges{};
+        for (StrandTable *table : {&m_lodRanges.strips, &m_lodRanges.ribbons})
+        {
+            table->first.reserve(n);
+            table->count.reserve(n);
+        }
+
+        const size_t clusters = (n + LOD_CLUSTER_STRANDS - 1) / LOD_CLUSTER_STRANDS;
+        uint32_t bits = 0;
+        while ((size_t(1) << bits) < clusters)
+            bits++;
+        for (size_t k = 0; k < (size_t(1) << bits); k++)
+        {
+            const size_t c = bits ? utils::reverse_bits(static_cast<uint32_t>(k)) >> (32 - bits) : 0;
+            if (c >= clusters)
+                continue;
+            for (size_t s = c * LOD_CLUSTER_STRANDS; s < std::min(n, (c + 1) * LOD_CLUSTER_STRANDS); s++)
+            {
+                m_lodRanges.strips.push_back(strands.first[s] + guards, strands.count[s]);
+                m_lodRanges.ribbons.push_back(2 * strands.first[s], 2 * strands.count[s]);
+            }
+        }
+    }
+
+    // Strips widened by a vertex on each side, in the same order
+    if (adjacency)
+    {
+        for (size_t i = ranges.adjacency.size(); i < ranges.strips.size(); i++)
+            ranges.adjacency.push_back(ranges.strips.first[i] - 1, ranges.strips.count[i] + 2);
+    }
+
+    return ranges;
+}
+
+void HairMesh::bind_vertex_storage(unsigned int binding) const
+{
+    if (m_buffer_loaded && m_vertexCount > 0)
+    {
+        GL_CHECK(glBindBufferRange(GL_SHADER_STORAGE_BUFFER, binding, m_vbo, m_guardVertices * sizeof(StrandVertex), m_vertexCount * sizeof(StrandVertex)));
+    }
+}
+
+void HairMesh::bind_strand_storage(unsigned int binding) const
+{
+    if (m_buffer_loaded && m_strandBuffer)
+    {
+        GL_CHECK(glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, m_strandBuffer));
+    }
+}
+
+GLIB_NAMESPACE_END
@@ -0,0 +1,269 @@
+#ifndef __HAIR_MESH__
+#define __HAIR_MESH__
+
+#include "mesh.h"
+
+GLIB_NAMESPACE_BEGIN
+
+/*
+First vertex and vertex count of every strand (any run of vertices drawn as a line strip).
+Kept as two arrays so they can be passed straight to glMultiDrawArrays.
+*/
+struct StrandTable
+{
+    std::vector<int> first;
+    std::vector<int> count;
+
+    inline size_t size() const { return first.size(); }
+    inline bool empty() const { return first.empty(); }
+    inline void resize(size_t n)
+    {
+        first.resize(n);
+        count.resize(n);
+    }
+    inline void push_back(int f, int c)
+    {
+        first.push_back(f);
+        count.push_back(c);
+    }
+};
+
+/*
+Hair strands as structure of arrays. Vertex attributes are stored per vertex, the rest once per strand, and the
+strand table tells where every strand lies in the vertex arrays. Strands are stored back to back.
+*/
+struct HairGeometry
+{
+    // Per vertex
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> tangents;
+
+    // Per strand
+    StrandTable strands;
+    std::vector<glm::vec3> colors;
+    std::vector<float> thickness; // Multiplies the material thickness
+
+    inline size_t vertex_count() const { return positions.size(); }
+    inline size_t strand_count() const { return strands.size(); }
+
+    inline void resize(size_t vertices, size_t strandCount)
+    {
+        positions.resize(vertices);
+        tangents.resize(vertices);
+        strands.resize(strandCount);
+        colors.resize(strandCount);
+        thickness.resize(strandCount, 1.0f);
+    }
+
+    /*
+    Copies strands [strandStart, strandEnd) into a self contained geometry, its strand table relative to its own vertices.
+    */
+    HairGeometry extract(size_t strandStart, size_t strandEnd) const;
+
+    /*
+    Appends a self contained geometry, rebasing its strand table.
+    */
+    void append(const HairGeometry &other);
+
+    /*
+    Reorders the strands so strand i is the former strand order[i], moving its vertices and per strand data along.
+    */
+    void permute_strands(const std::vector<uint32_t> &order);
+
+    /*
+    Sorts the strands along a Morton curve of their roots, so strands drawn one after another lie close together.
+    Keeps vertex caches, rasterization and contiguous strand ranges (culling, LOD) spatially coherent.
+    */
+    void sort_strands_by_root();
+
+    /*
+    Frees everything but the strand table, which is all a drawn hair mesh needs on the CPU.
+    */
+    void release_attributes();
+
+    Sphere compute_bounding_sphere() const;
+};
+
+/*
+Compact vertex for hair strands on the GPU, 16 bytes instead of the 56 of Vertex. Positions are quantized within the
+bounding box of their strand and tangents are octahedral encoded. Whatever is constant along a strand is stored once
+in its StrandAttributes. Matches resources/shaders/include/strand-vertex.glsl.
+*/
+struct StrandVertex
+{
+    uint16_t position[3]; // UNORM16 within the strand box
+    uint16_t parameter;   // UNORM16 distance along the strand in vertices, 0 at the root and 1 at the tip
+    int16_t tangent[2];   // SNORM16 octahedral
+    uint32_t strand;      // Index of the strand attributes
+
+    // Strand id of the guard vertices around the strands, which belong to none
+    static constexpr uint32_t GUARD = 0xFFFFFFFFu;
+};
+static_assert(sizeof(StrandVertex) == 16, "StrandVertex must match its shader layout");
+
+/*
+Per strand data of strand vertices, read by shaders from a storage buffer (std430).
+*/
+struct StrandAttributes
+{
+    glm::vec3 boxMin;
+    float thickness; // Multiplies the material thickness
+    glm::vec3 boxExtent;
+    uint32_t color; // RGBA8
+};
+static_assert(sizeof(StrandAttributes) == 32, "StrandAttributes must match its std430 layout");
+
+#pragma region HAIR MESH
+
+/*
+Mesh made of hair strands. Vertices are uploaded in the StrandVertex format, without index buffer, and every strand is
+drawn as a line strip of its own vertex range with a single multi draw call.
+
+On the GPU the strand vertices are framed by guard vertices, so the first root and the last tip also have a neighbor
+to be drawn with adjacency. The leading guards fill a whole storage buffer offset alignment, which lets
+bind_vertex_storage() leave them out and shaders index vertices as the CPU does.
+*/
+class HairMesh : public Mesh
+{
+protected:
+    HairGeometry m_hairGeometry;
+
+    unsigned int m_strandBuffer{0}; // Strand attributes
+
+    size_t m_guardVertices{0}; // Leading guard vertices in the vertex buffer
+
+    // Multi draw ranges in the vertex buffer, one entry per strand
+    struct DrawRanges
+    {
+        StrandTable strips;
+        StrandTable adjacency; // Only built once something draws with adjacency
+        StrandTable ribbons;   // In ribbon vertices, two per strand vertex, guards left out
+    };
+    DrawRanges m_storageRanges; // Storage order, extended as strands arrive
+    DrawRanges m_lodRanges;     // LOD order, rebuilt as strands arrive
+
+    // Strands drawn together by LOD draws, consecutive in storage order
+    static constexpr size_t LOD_CLUSTER_STRANDS = 64;
+
+    struct HairStreamState
+    {
+        size_t strandCapacity{0};
+        utils::SafeQueue<HairGeometry> pending;
+        HairGeometry current;                     // Batch being uploaded
+        std::vector<StrandVertex> packedVertices; // Current batch in the GPU format
+    };
+    HairStreamState m_hairStream{};
+
+    void setup_vertex_attributes();
+
+    void reserve_stream_buffers(size_t vertices, size_t strands);
+
+    void release_geometry() override;
+
+    /*
+    Fills the vertex buffer with count guard vertices from vertex on.
+    */
+    void write_guards(size_t vertex, size_t count);
+
+    /*
+    Brings the draw ranges for drawing strandCount strands up to the current strands and returns them. The adjacency
+    ranges only if adjacency is asked.
+    */
+    const DrawRanges &update_draw_ranges(size_t strandCount, bool adjacency);
+
+public:
+    HairMesh() : Mesh() { set_name("Hair"); }
+    ~HairMesh()
+    {
+        if (m_strandBuffer)
+        {
+            GL_CHECK(glDeleteBuffers(1, &m_strandBuffer));
+        }
+    }
+
+    /*
+    Takes ownership of the geometry buffers.
+    */
+    void set_geometry(HairGeometry &&g);
+
+    /*
+    CPU copy of the strands. Only the strand table is left once uploaded if the mesh releases it.
+    */
+    inline const HairGeometry &get_hair_geometry() const { return m_hairGeometry; }
+
+    /*
+    GL thread only. Decodes a released CPU copy back from the GPU buffers. Positions and tangents come back with
+    the precision of StrandVertex.
+    */
+    void read_back_geometry() override;
+
+    inline size_t get_strand_count() const { return m_hairGeometry.strand_count(); }
+
+    /*
+    Moves the geometry and bounding volume out of source, leaving it empty.
+    */
+    void take_geometry_from(HairMesh *const source);
+
+    /*
+    Packs strands [strandStart, strandEnd) of g. Vertex strand ids are offset by strandOffset.
+    */
+    static void pack_strands(const HairGeometry &g, size_t strandStart, size_t strandEnd, size_t strandOffset,
+                             std::vector<StrandVertex> &vertices, std::vector<StrandAttributes> &attributes);
+
+    /*
+    Inverse of pack_strands. The strand table of g has to be in place already.
+    */
+    static void unpack_strands(const std::vector<StrandVertex> &vertices, const std::vector<StrandAttributes> &attributes, HairGeometry &g);
+
+    void generate_buffers() override;
+
+#pragma region STREAMING
+    /*
+    Thread safe. Queues a batch of strands whose strand table is relative to its own vertices.
+    */
+    inline void push_batch(HairGeometry &&batch) { m_hairStream.pending.push(std::move(batch)); }
+
+    void upload_streamed_batches() override;
+#pragma endregion
+
+    /*
+    Draws every strand, see draw_strands().
+    */
+    inline void draw(bool useMaterial = true, unsigned int drawingPrimitive = GL_LINE_STRIP) override
+    {
+        draw_strands(get_strand_count(), useMaterial, drawingPrimitive);
+    }
+
+    /*
+    Draws only the first strandCount strands of the LOD order, for strand density LOD. hair_loaders store strands
+    along a Morton curve of their roots (neural grooms keep guides and grown strands on separate curves), streamed or
+    not. Drawing every strand follows that storage order. The LOD order cuts it into clusters of LOD_CLUSTER_STRANDS
+    consecutive strands and takes them in bit reversed cluster index order, so any prefix is an evenly spread
+    subsample of the groom made of small spatially coherent patches.
+
+    Strands are drawn as line strips, or as GL_LINE_STRIP_ADJACENCY or GL_TRIANGLE_STRIP if asked, any other
+    primitive is ignored.
+    With adjacency every strand also gets the vertex before its root and the one after its tip. Those belong to
+    another strand or are guards, so geometry shaders tell a missing neighbor by its different strand id.
+    Triangle strips are camera facing ribbons built by the vertex shader without vertex attributes. Every strand
+    vertex is drawn twice: gl_VertexID / 2 indexes the strand vertices bound with bind_vertex_storage() and
+    gl_VertexID & 1 tells the side (see resources/shaders/include/strand-ribbon.glsl).
+    */
+    void draw_strands(size_t strandCount, bool useMaterial = true, unsigned int drawingPrimitive = GL_LINE_STRIP);
+
+    /*
+    Exposes the strand vertices, without guards, to shaders as a storage buffer on binding.
+    */
+    void bind_vertex_storage(unsigned int binding) const override;
+
+    /*
+    Exposes the strand attributes to shaders as a storage buffer on binding.
+    */
+    void bind_strand_storage(unsigned int binding) const;
+};
+
+#pragma endregion
+
+GLIB_NAMESPACE_END
+
+#endif
@@ -5,7 +5,108 @@
 
 GLIB_NAMESPACE_BEGIN
 
-void loaders::load_OBJ(Mesh *const mesh, const char *fileName, bool importMaterials, bool calculateTangents)
+namespace
+{
+    /*
+    Open addressing map from tinyobj index triples to the vertex built for them. Two corners of a face refer to
+    the same vertex exactly when their position, normal and texcoord indices match, so comparing three ints
+    replaces hashing and comparing whole vertices. Sized once for the worst case (every corner unique) with a load
+    factor of at most one half, so it never rehashes and probes stay short.
+    */
+    class IndexTripleMap
+    {
+        struct Slot
+        {
+            tinyobj::index_t key;
+            unsigned int value;
+        };
+        static constexpr unsigned int EMPTY = std::numeric_limits<unsigned int>::max();
+
+        std::vector<Slot> m_slots;
+        size_t m_mask;
+
+        static inline size_t hash(const tinyobj::index_t &k)
+        {
+            uint64_t h = static_cast<uint32_t>(k.vertex_index) * 0x9E3779B97F4A7C15ull;
+            h ^= static_cast<uint32_t>(k.normal_index) * 0xC2B2AE3D27D4EB4Full;
+            h ^= static_cast<uint32_t>(k.texcoord_index) * 0x165667B19E3779F9ull;
+            return static_cast<size_t>(h ^ (h >> 29));
+        }
+
+    public:
+        IndexTripleMap(size_t maxKeys)
+        {
+            size_t capacity = 16;
+            while (capacity < 2 * maxKeys)
+                capacity <<= 1;
+            m_slots.assign(capacity, Slot{{0, 0, 0}, EMPTY});
+            m_mask = capacity - 1;
+        }
+
+        /*
+        Returns the value stored for key, inserting newValue first if the key is not there yet.
+        */
+        inline unsigned int find_or_insert(const tinyobj::index_t &key, unsigned int newValue, bool &inserted)
+        {
+            for (size_t i = hash(key) & m_mask;; i = (i + 1) & m_mask)
+            {
+                Slot &slot = m_slots[i];
+                if (slot.value == EMPTY)
+                {
+                    slot = {key, newValue};
+                    inserted = true;
+                    return newValue;
+                }
+                if (slot.key.vertex_index == key.vertex_index && slot.key.normal_index == key.normal_index &&
+                    slot.key.texcoord_index == key.texcoord_index)
+                {
+                    inserted = false;
+                    return slot.value;
+                }
+            }
+        }
+    };
+
+    Vertex get_OBJ_vertex(const tinyobj::attrib_t &attrib, const tinyobj::index_t &index)
+    {
+        Vertex vertex = {};
+
+        // Position and color
+        if (index.vertex_index >= 0)
+        {
+            vertex.position.x = attrib.vertices[3 * index.vertex_index + 0];
+            vertex.position.y = attrib.vertices[3 * index.vertex_index + 1];
+            vertex.position.z = attrib.vertices[3 * index.vertex_index + 2];
+
+            if (!attrib.colors.empty())
+            {
+                vertex.color.r = attrib.colors[3 * index.vertex_index + 0];
+                vertex.color.g = attrib.colors[3 * index.vertex_index + 1];
+                vertex.color.b = attrib.colors[3 * index.vertex_index + 2];
+            }
+        }
+        // Normal
+        if (index.normal_index >= 0)
+        {
+            vertex.normal.x = attrib.normals[3 * index.normal_index + 0];
+            vertex.normal.y = attrib.normals[3 * index.normal_index + 1];
+            vertex.normal.z = attrib.normals[3 * index.normal_index + 2];
+        }
+
+        vertex.tangent = {0.0, 0.0, 0.0};
+
+        // UV
+        if (index.texcoord_index >= 0)
+        {
+            vertex.uv.x = attrib.texcoords[2 * index.texcoord_index + 0];
+            vertex.uv.y = attrib.texcoords[2 * index.texcoord_index + 1];
+        }
+
+        return vertex;
+    }
+}
+
+bool loaders::load_OBJ(Mesh *const mesh, const char *fileName, bool importMaterials, bool calculateTangents)
 {
     // Preparing output
     tinyobj::attrib_t attrib;
@@ -25,60 +126,34 @@ void loaders::load_OBJ(Mesh *const mesh, const char *fileName, bool importMateri
     {
         ERR_LOG(err);
         DEBUG_LOG("ERROR: Couldn't load mesh");
-        return;
+        return false;
     }
+    if (shapes.empty())
+        return false;
 
-    std::vector<Vertex> vertices;
-    std::vector<unsigned int> indices;
-    std::unordered_map<Vertex, unsigned int> uniqueVertices;
+    // Shapes are deduplicated independently and in parallel, then appended in file order
+    std::vector<Geometry> parts(shapes.size());
+    utils::parallel_for(0, shapes.size(), [&](size_t shape_id)
+                        {
+        const tinyobj::shape_t &shape = shapes[shape_id];
+        std::vector<Vertex> &vertices = parts[shape_id].vertices;
+        std::vector<unsigned int> &indices = parts[shape_id].indices;
 
-    size_t shape_id = 0;
-    // attrib.
-    for (const tinyobj::shape_t &shape : shapes)
-    {
         if (!shape.mesh.indices.empty())
+        {
             // IS INDEXED
+            IndexTripleMap uniqueVertices(shape.mesh.indices.size());
+            indices.reserve(shape.mesh.indices.size());
             for (const tinyobj::index_t &index : shape.mesh.indices)
             {
-                Vertex vertex = {};
+                bool inserted;
+                const unsigned int id = uniqueVertices.find_or_insert(index, static_cast<unsigned int>(vertices.size()), inserted);
+                if (inserted)
+                    vertices.push_back(get_OBJ_vertex(attrib, index));
 
-                // positionition and color
-                if (index.vertex_index >= 0)
-                {
-                    vertex.position.x = attrib.vertices[3 * index.vertex_index + 0];
-                    vertex.position.y = attrib.vertices[3 * index.vertex_index + 1];
-                    vertex.position.z = attrib.vertices[3 * index.vertex_index + 2];
-
-                    vertex.color.r = attrib.colors[3 + index.vertex_index + 0];
-                    vertex.color.g = attrib.colors[3 + index.vertex_index + 1];
-                    vertex.color.b = attrib.colors[3 + index.vertex_index + 2];
-                }
-                // Normal
-                if (index.normal_index >= 0)
-                {
-                    vertex.normal.x = attrib.normals[3 * index.normal_index + 0];
-                    vertex.normal.y = attrib.normals[3 * index.normal_index + 1];
-                    vertex.normal.z = attrib.normals[3 * index.normal_index + 2];
-                }
-
-                vertex.tangent = {0.0, 0.0, 0.0};
-
-                // UV
-                if (index.texcoord_index >= 0)
-                {
-                    vertex.uv.x = attrib.texcoords[2 * index.texcoord_index + 0];
-                    vertex.uv.y = attrib.texcoords[2 * index.texcoord_index + 1];
-                }
-
-                // Check if the vertex is already in the map
-                if (uniqueVertices.count(vertex) == 0)
-                {
-                    uniqueVertices[vertex] = static_cast<unsigned int>(vertices.size());
-                    vertices.push_back(vertex);
-                }
-
-                indices.push_back(uniqueVertices[vertex]);
+                indices.push_back(id);
             }
+        }
         else
             // NOT INDEXED
             for (size_t i = 0; i < shape.mesh.num_face_vertices.size(); i++)
@@ -121,18 +196,595 @@ void loaders::load_OBJ(Mesh *const mesh, const char *fileName, bool importMateri
 
                     vertices.push_back(vertex);
                 }
+            } },
+                        1);
+
+    size_t vertexCount = 0;
+    size_t indexCount = 0;
+    for (const Geometry &part : parts)
+    {
+        vertexCount += part.vertices.size();
+        indexCount += part.indices.size();
+    }
+
+    Geometry g;
+    g.vertices.reserve(vertexCount);
+    g.indices.reserve(indexCount);
+    for (Geometry &part : parts)
+    {
+        const unsigned int offset = static_cast<unsigned int>(g.vertices.size());
+        g.vertices.insert(g.vertices.end(), part.vertices.begin(), part.vertices.end());
+        for (unsigned int index : part.indices)
+            g.indices.push_back(index + offset);
+        part = Geometry{};
+    }
+    mesh->set_geometry(std::move(g));
+    return true;
+}
+
+namespace
+{
+    enum class PLYScalar
+    {
+        FLOAT,
+        UCHAR,
+        OTHER
+    };
+
+    struct PLYProperty
+    {
+        std::string name;
+        PLYScalar type;
+        size_t offset; // Bytes within a binary vertex record, tokens within an ASCII vertex line
+    };
+
+    /*
+    PLY layout the fast path can read: a vertex element of scalars, optionally followed by a face element holding
+    a single list of 32 bit indices. Either binary little endian or ASCII, one element per line.
+    */
+    struct PLYLayout
+    {
+        bool ascii{false};
+        size_t dataOffset{0};
+        size_t vertexCount{0};
+        size_t vertexStride{0};
+        std::vector<PLYProperty> vertexProperties;
+        size_t faceCount{0};
+        bool faceList{false};
+    };
+
+    size_t get_PLY_type_size(const std::string &type)
+    {
+        if (type == "char" || type == "uchar" || type == "int8" || type == "uint8")
+            return 1;
+        if (type == "short" || type == "ushort" || type == "int16" || type == "uint16")
+            return 2;
+        if (type == "int" || type == "uint" || type == "int32" || type == "uint32" || type == "float" || type == "float32")
+            return 4;
+        if (type == "double" || type == "float64")
+            return 8;
+        return 0;
+    }
+
+    bool parse_PLY_layout(const uint8_t *data, size_t size, PLYLayout &layout)
+    {
+        size_t cursor = 0;
+        std::string line;
+        auto nextLine = [&]()
+        {
+            const void *newLine = std::memchr(data + cursor, '\n', size - cursor);
+            if (!newLine)
+                return false;
+            const size_t end = static_cast<const uint8_t *>(newLine) - data;
+            line.assign(reinterpret_cast<const char *>(data) + cursor, end - cursor);
+            if (!line.empty() && line.back() == '\r')
+                line.pop_back();
+            cursor = end + 1;
+            return true;
+        };
+
+        if (!nextLine() || line != "ply")
+            return false;
+        if (!nextLine() || (line != "format binary_little_endian 1.0" && line != "format ascii 1.0"))
+            return false;
+        layout.ascii = line == "format ascii 1.0";
+
+        std::string element;
+        while (nextLine())
+        {
+            std::istringstream tokens(line);
+            std::string keyword;
+            tokens >> keyword;
+
+            if (keyword == "comment" || keyword == "obj_info")
+                continue;
+            if (keyword == "end_header")
+            {
+                layout.dataOffset = cursor;
+                return layout.vertexStride > 0 && (layout.faceCount == 0 || layout.faceList);
+            }
+            if (keyword == "element")
+            {
+                size_t count = 0;
+                tokens >> element >> count;
+                // Vertices first, then faces, nothing else
+                if (element == "vertex" && layout.vertexStride == 0 && layout.vertexCount == 0)
+                    layout.vertexCount = count;
+                else if (element == "face" && layout.vertexStride > 0 && layout.faceCount == 0)
+                    layout.faceCount = count;
+                else
+                    return false;
+            }
+            else if (keyword == "property")
+            {
+                std::string type, name;
+                tokens >> type;
+                if (element == "vertex")
+                {
+                    tokens >> name;
+                    const size_t bytes = get_PLY_type_size(type);
+                    if (bytes == 0)
+                        return false;
+                    PLYScalar scalar = PLYScalar::OTHER;
+                    if (type == "float" || type == "float32")
+                        scalar = PLYScalar::FLOAT;
+                    else if (type == "uchar" || type == "uint8")
+                        scalar = PLYScalar::UCHAR;
+                    layout.vertexProperties.push_back({name, scalar, layout.vertexStride});
+                    layout.vertexStride += layout.ascii ? 1 : bytes;
+                }
+                else if (element == "face")
+                {
+                    std::string countType, indexType;
+                    tokens >> countType >> indexType >> name;
+                    const bool intIndex = indexType == "int" || indexType == "uint" || indexType == "int32" || indexType == "uint32";
+                    if (type != "list" || layout.faceList || get_PLY_type_size(countType) != 1 || !intIndex)
+                        return false;
+                    layout.faceList = true;
+                }
+                else
+                    return false;
             }
+            else
+                return false;
+        }
+        return false;
+    }
 
-        Geometry g;
-        g.vertices = vertices;
-        g.indices = indices;
-        mesh->set_geometry(g);
+    /*
+    Text cut at line boundaries into about one range per task, with the index of the first line of each range.
+    The text is expected to end with a line break.
+    */
+    struct TextLines
+    {
+        std::vector<size_t> begin;     // Range r spans [begin[r], begin[r + 1])
+        std::vector<size_t> firstLine; // Lines before range r
+        size_t count{0};
+    };
 
-        shape_id++;
+    TextLines split_lines(const char *text, size_t size)
+    {
+        const size_t RANGES = 4 * utils::ThreadPool::global().size();
+        TextLines lines;
+        lines.begin.push_back(0);
+        for (size_t r = 1; r < RANGES; r++)
+        {
+            const size_t cut = std::max(size * r / RANGES, lines.begin.back());
+            const void *newLine = cut < size ? std::memchr(text + cut, '\n', size - cut) : nullptr;
+            lines.begin.push_back(newLine ? static_cast<const char *>(newLine) - text + 1 : size);
+        }
+        lines.begin.push_back(size);
+
+        lines.firstLine.assign(RANGES + 1, 0);
+        utils::parallel_for(0, RANGES, [&](size_t r)
+                            { lines.firstLine[r + 1] = std::count(text + lines.begin[r], text + lines.begin[r + 1], '\n'); },
+                            1);
+        for (size_t r = 0; r < RANGES; r++)
+            lines.firstLine[r + 1] += lines.firstLine[r];
+        lines.count = lines.firstLine[RANGES];
+        return lines;
+    }
+
+    /*
+    Calls body(line, begin, end) on the first maxLines lines in parallel, end pointing at the line break.
+    */
+    template <typename F>
+    void for_each_line(const char *text, const TextLines &lines, size_t maxLines, F &&body)
+    {
+        utils::parallel_for(0, lines.begin.size() - 1, [&](size_t r)
+                            {
+            const char *cursor = text + lines.begin[r];
+            const char *end = text + lines.begin[r + 1];
+            for (size_t line = lines.firstLine[r]; cursor < end && line < maxLines; line++)
+            {
+                const char *lineEnd = static_cast<const char *>(std::memchr(cursor, '\n', end - cursor));
+                body(line, cursor, lineEnd);
+                cursor = lineEnd + 1;
+            } },
+                            1);
+    }
+
+    /*
+    Offset of the first byte of line n, or the text size if there are no more lines.
+    */
+    size_t get_line_offset(const char *text, const TextLines &lines, size_t n)
+    {
+        if (n >= lines.count)
+            return lines.begin.back();
+        const size_t r = std::upper_bound(lines.firstLine.begin(), lines.firstLine.end(), n) - lines.firstLine.begin() - 1;
+        size_t offset = lines.begin[r];
+        for (size_t line = lines.firstLine[r]; line < n; line++)
+            offset = static_cast<const char *>(std::memchr(text + offset, '\n', lines.begin[r + 1] - offset)) - text + 1;
+        return offset;
+    }
+
+    /*
+    Parses the next number of a line, skipping the blanks before it.
+    */
+    template <typename T>
+    bool parse_token(const char *&cursor, const char *end, T &value)
+    {
+        while (cursor < end && (*cursor == ' ' || *cursor == '\t' || *cursor == '\r'))
+            cursor++;
+        const std::from_chars_result result = std::from_chars(cursor, end, value);
+        if (result.ec != std::errc())
+            return false;
+        cursor = result.ptr;
+        return true;
     }
 }
 
-void loaders::load_PLY(Mesh *const mesh, const char *fileName, bool preload, bool verbose, bool calculateTangents)
+loaders::PLYStreamReader::PLYStreamReader(const char *fileName, size_t chunkBytes) : m_file(fileName, std::ios::binary), m_chunkBytes(chunkBytes)
+{
+    // Data is read in place, which needs a little endian host
+    const uint16_t ENDIANNESS = 1;
+    if (*reinterpret_cast<const uint8_t *>(&ENDIANNESS) != 1 || !m_file)
+        return;
+
+    // The header is read block by block until its end is in
+    const char END_HEADER[] = "end_header";
+    const size_t BLOCK_SIZE = 4096;
+    const size_t MAX_HEADER_SIZE = size_t(1) << 20;
+    std::vector<uint8_t> header;
+    size_t endHeader = std::string::npos;
+    while (endHeader == std::string::npos && header.size() < MAX_HEADER_SIZE)
+    {
+        const size_t size = header.size();
+        header.resize(size + BLOCK_SIZE);
+        m_file.read(reinterpret_cast<char *>(header.data() + size), BLOCK_SIZE);
+        header.resize(size + m_file.gcount());
+        if (header.size() == size)
+            break;
+        // Complete once the line ends
+        const std::string_view text(reinterpret_cast<const char *>(header.data()), header.size());
+        const size_t keyword = text.find(END_HEADER);
+        if (keyword != std::string::npos)
+            endHeader = text.find('\n', keyword);
+    }
+
+    PLYLayout layout;
+    if (endHeader == std::string::npos || !parse_PLY_layout(header.data(), header.size(), layout))
+        return;
+
+    // Offsets of a group of properties. Present properties of an unexpected type rule the reader out.
+    // ASCII numbers are all parsed as floats, whatever their declared type
+    bool supported = true;
+    PLYScalar colorType = PLYScalar::UCHAR;
+    auto find = [&](std::initializer_list<const char *> names, PLYScalar type, size_t *offsets)
+    {
+        size_t i = 0;
+        for (const char *name : names)
+        {
+            auto property = std::find_if(layout.vertexProperties.begin(), layout.vertexProperties.end(), [&](const PLYProperty &p)
+                                         { return p.name == name; });
+            if (property == layout.vertexProperties.end())
+                return false;
+            const bool asciiColor = layout.ascii && type == PLYScalar::UCHAR && property->type == PLYScalar::FLOAT;
+            if (property->type != type && !(layout.ascii && type == PLYScalar::FLOAT) && !asciiColor)
+            {
+                supported = false;
+                return false;
+            }
+            if (type == PLYScalar::UCHAR)
+                colorType = property->type;
+            offsets[i++] = property->offset;
+        }
+        return true;
+    };
+
+    const bool hasPosition = find({"x", "y", "z"}, PLYScalar::FLOAT, m_position);
+    const bool hasNormal = find({"nx", "ny", "nz"}, PLYScalar::FLOAT, m_normal);
+    const bool hasColor = find({"red", "green", "blue"}, PLYScalar::UCHAR, m_color) || find({"r", "g", "b"}, PLYScalar::UCHAR, m_color);
+    const bool hasUV = find({"u", "v"}, PLYScalar::FLOAT, m_uv) || find({"s", "t"}, PLYScalar::FLOAT, m_uv);
+    if (!hasPosition || !supported)
+        return;
+
+    if (layout.ascii)
+    {
+        // Slots follow the order of Vertex: position, normal, color, uv
+        m_tokenSlots.assign(layout.vertexStride, -1);
+        for (int8_t k = 0; k < 3; k++)
+        {
+            m_tokenSlots[m_position[k]] = k;
+            if (hasNormal)
+                m_tokenSlots[m_normal[k]] = 3 + k;
+            if (hasColor)
+                m_tokenSlots[m_color[k]] = 6 + k;
+        }
+        if (hasUV)
+        {
+            m_tokenSlots[m_uv[0]] = 9;
+            m_tokenSlots[m_uv[1]] = 10;
+        }
+        m_colorRange = colorType == PLYScalar::FLOAT ? 1.0f : 255.0f;
+    }
+    else
+    {
+        // A truncated file is better refused upfront than found out halfway
+        const size_t FACE_STRIDE = 1 + 3 * sizeof(unsigned int);
+        m_file.clear();
+        m_file.seekg(0, std::ios::end);
+        const size_t fileSize = static_cast<size_t>(m_file.tellg());
+        if (layout.dataOffset + layout.vertexCount * layout.vertexStride + layout.faceCount * FACE_STRIDE > fileSize)
+            return;
+    }
+    m_file.clear();
+    m_file.seekg(layout.dataOffset, std::ios::beg);
+
+    m_vertexCount = layout.vertexCount;
+    m_faceCount = layout.faceCount;
+    m_vertexStride = layout.vertexStride;
+    m_ascii = layout.ascii;
+    m_info = {hasNormal, hasColor, hasUV, layout.faceCount > 0};
+    m_supported = true;
+}
+
+size_t loaders::PLYStreamReader::read_text()
+{
+    // Text is about as big as the vertices made from it, so it gets half the chunk
+    const size_t TEXT_BYTES = std::max<size_t>(m_chunkBytes / 2, 1);
+    size_t request = m_textSize < TEXT_BYTES ? TEXT_BYTES - m_textSize : 0;
+    while (true)
+    {
+        if (request > 0 && m_file)
+        {
+            m_chunk.resize(m_textSize + request);
+            m_file.read(reinterpret_cast<char *>(m_chunk.data() + m_textSize), request);
+            m_textSize += m_file.gcount();
+        }
+
+        const auto text = m_chunk.begin(), textEnd = m_chunk.begin() + m_textSize;
+        const auto lastBreak = std::find(std::make_reverse_iterator(textEnd), std::make_reverse_iterator(text), '\n');
+        if (lastBreak.base() != text)
+            return lastBreak.base() - text;
+
+        if (!m_file)
+        {
+            if (m_textSize == 0)
+                return 0;
+            m_chunk.resize(m_textSize + 1);
+            m_chunk[m_textSize++] = '\n';
+            return m_textSize;
+        }
+        // A line longer than the chunk, keep reading until it ends
+        request = TEXT_BYTES;
+    }
+}
+
+void loaders::PLYStreamReader::consume_text(size_t bytes)
+{
+    std::memmove(m_chunk.data(), m_chunk.data() + bytes, m_textSize - bytes);
+    m_textSize -= bytes;
+}
+
+size_t loaders::PLYStreamReader::read_ascii_vertices(std::vector<Vertex> &vertices, const Vertex &defaults)
+{
+    const size_t size = read_text();
+    const char *text = reinterpret_cast<const char *>(m_chunk.data());
+    const TextLines lines = split_lines(text, size);
+    // Lines past the vertices are faces, left for later
+    const size_t count = std::min(lines.count, m_vertexCount - m_verticesRead);
+    if (count == 0)
+    {
+        m_supported = false;
+        return 0;
+    }
+
+    const size_t base = vertices.size();
+    vertices.resize(base + count);
+    std::atomic<bool> valid{true};
+    for_each_line(text, lines, count, [&](size_t line, const char *cursor, const char *end)
+                  {
+        float slots[11] = {};
+        for (const int8_t slot : m_tokenSlots)
+        {
+            float value;
+            if (!parse_token(cursor, end, value))
+            {
+                valid = false;
+                return;
+            }
+            if (slot >= 0)
+                slots[slot] = value;
+        }
+        Vertex v = defaults;
+        v.position = {slots[0], slots[1], slots[2]};
+        if (m_info.normals)
+            v.normal = {slots[3], slots[4], slots[5]};
+        if (m_info.colors)
+            v.color = glm::vec3(slots[6], slots[7], slots[8]) / m_colorRange;
+        if (m_info.texcoords)
+            v.uv = {slots[9], slots[10]};
+        vertices[base + line] = v; });
+    if (!valid)
+    {
+        m_supported = false;
+        return 0;
+    }
+
+    consume_text(get_line_offset(text, lines, count));
+    m_verticesRead += count;
+    return count;
+}
+
+size_t loaders::PLYStreamReader::read_ascii_faces(std::vector<unsigned int> &indices)
+{
+    const size_t size = read_text();
+    const char *text = reinterpret_cast<const char *>(m_chunk.data());
+    const TextLines lines = split_lines(text, size);
+    const size_t count = std::min(lines.count, m_faceCount - m_facesRead);
+    if (count == 0)
+    {
+        m_supported = false;
+        return 0;
+    }
+
+    const size_t base = indices.size();
+    indices.resize(base + 3 * count);
+    std::atomic<bool> triangles{true};
+    for_each_line(text, lines, count, [&](size_t line, const char *cursor, const char *end)
+                  {
+        unsigned int corners = 0;
+        if (!parse_token(cursor, end, corners) || corners != 3)
+        {
+            triangles = false;
+            return;
+        }
+        for (size_t k = 0; k < 3; k++)
+            if (!parse_token(cursor, end, indices[base + 3 * line + k]))
+            {
+                triangles = false;
+                return;
+            } });
+    if (!triangles)
+    {
+        m_supported = false;
+        return 0;
+    }
+
+    consume_text(get_line_offset(text, lines, count));
+    m_facesRead += count;
+    return count;
+}
+
+size_t loaders::PLYStreamReader::read_vertices(std::vector<Vertex> &vertices, const Vertex &defaults)
+{
+    if (!m_supported || m_verticesRead == m_vertexCount)
+        return 0;
+    if (m_ascii)
+        return read_ascii_vertices(vertices, defaults);
+
+    // The chunk holds the raw records and their conversion
+    const size_t CHUNK_VERTICES = std::max<size_t>(m_chunkBytes / (m_vertexStride + sizeof(Vertex)), 1);
+    const size_t count = std::min(CHUNK_VERTICES, m_vertexCount - m_verticesRead);
+    m_chunk.resize(count * m_vertexStride);
+    if (!m_file.read(reinterpret_cast<char *>(m_chunk.data()), m_chunk.size()))
+    {
+        m_supported = false;
+        return 0;
+    }
+
+    auto readFloat = [](const uint8_t *bytes)
+    {
+        float value;
+        std::memcpy(&value, bytes, sizeof(float));
+        return value;
+    };
+
+    // Records have a fixed size, so every vertex is converted independently
+    const size_t base = vertices.size();
+    vertices.resize(base + count);
+    utils::parallel_for_range(0, count, [&](size_t start, size_t end)
+                              {
+        for (size_t i = start; i < end; i++)
+        {
+            const uint8_t *record = m_chunk.data() + i * m_vertexStride;
+            Vertex v = defaults;
+            v.position = {readFloat(record + m_position[0]), readFloat(record + m_position[1]), readFloat(record + m_position[2])};
+            if (m_info.normals)
+                v.normal = {readFloat(record + m_normal[0]), readFloat(record + m_normal[1]), readFloat(record + m_normal[2])};
+            if (m_info.colors)
+                v.color = {record[m_color[0]] / 255.0f, record[m_color[1]] / 255.0f, record[m_color[2]] / 255.0f};
+            if (m_info.texcoords)
+                v.uv = {readFloat(record + m_uv[0]), readFloat(record + m_uv[1])};
+            vertices[base + i] = v;
+        } });
+
+    m_verticesRead += count;
+    return count;
+}
+
+size_t loaders::PLYStreamReader::read_faces(std::vector<unsigned int> &indices)
+{
+    if (!m_supported || m_verticesRead < m_vertexCount || m_facesRead == m_faceCount)
+        return 0;
+    if (m_ascii)
+        return read_ascii_faces(indices);
+
+    // Faces are expected to be triangles, checked while reading them
+    const size_t FACE_STRIDE = 1 + 3 * sizeof(unsigned int);
+    const size_t CHUNK_FACES = std::max<size_t>(m_chunkBytes / (FACE_STRIDE + 3 * sizeof(unsigned int)), 1);
+    const size_t count = std::min(CHUNK_FACES, m_faceCount - m_facesRead);
+    m_chunk.resize(count * FACE_STRIDE);
+    if (!m_file.read(reinterpret_cast<char *>(m_chunk.data()), m_chunk.size()))
+    {
+        m_supported = false;
+        return 0;
+    }
+
+    const size_t base = indices.size();
+    indices.resize(base + 3 * count);
+    std::atomic<bool> triangles{true};
+    utils::parallel_for_range(0, count, [&](size_t start, size_t end)
+                              {
+        for (size_t f = start; f < end; f++)
+        {
+            const uint8_t *record = m_chunk.data() + f * FACE_STRIDE;
+            if (record[0] != 3)
+            {
+                triangles = false;
+                return;
+            }
+            std::memcpy(&indices[base + 3 * f], record + 1, 3 * sizeof(unsigned int));
+        } });
+    if (!triangles)
+    {
+        m_supported = false;
+        return 0;
+    }
+
+    m_facesRead += count;
+    return count;
+}
+
+bool loaders::load_PLY_fast(const char *fileName, Geometry &g, const Vertex &defaults, PLYInfo *info, size_t chunkBytes)
+{
+    PLYStreamReader reader(fileName, chunkBytes);
+    if (!reader.is_supported())
+        return false;
+
+    std::vector<Vertex> vertices;
+    vertices.reserve(reader.get_vertex_count());
+    while (reader.read_vertices(vertices, defaults) > 0)
+        ;
+
+    std::vector<unsigned int> indices;
+    indices.reserve(3 * reader.get_face_count());
+    while (reader.read_faces(indices) > 0)
+        ;
+
+    // Unsupported faces or a read error turn up while reading
+    if (!reader.is_supported())
+        return false;
+
+    g.vertices = std::move(vertices);
+    g.indices = std::move(indices);
+    if (info)
+        *info = reader.get_info();
+    return true;
+}
+
+bool loaders::load_PLY(Mesh *const mesh, const char *fileName, bool preload, bool verbose, bool calculateTangents)
 {
 
     std::unique_ptr<std::istream> file_stream;
@@ -140,6 +792,19 @@ void loaders::load_PLY(Mesh *const mesh, const char *fileName, bool preload, boo
     std::string filePath = fileName;
     try
     {
+        // The usual layouts skip tinyply altogether
+        {
+            Geometry geom;
+            const Vertex DEFAULTS = {{0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f}, {0.0f, 0.0f}, {1.0f, 1.0f, 1.0f}};
+            if (load_PLY_fast(fileName, geom, DEFAULTS))
+            {
+                if (verbose)
+                    std::cout << "\tRead " << geom.vertices.size() << " total vertices and " << geom.indices.size() / 3 << " total faces (fast path)" << std::endl;
+                mesh->set_geometry(std::move(geom));
+                return true;
+            }
+        }
+
         // For most files < 1gb, pre-loading the entire file upfront and wrapping it into a
         // stream is a net win for parsing speed, about 40% faster.
         if (preload)
@@ -271,14 +936,13 @@ void loaders::load_PLY(Mesh *const mesh, const char *fileName, bool preload, boo
                 std::cerr << "tinyply exception: " << e.what() << std::endl;
         }
 
+        utils::ManualTimer readTimer;
+        readTimer.start();
+        file.read(*file_stream);
+        readTimer.stop();
+
         if (verbose)
         {
-            utils::ManualTimer readTimer;
-
-            readTimer.start();
-            file.read(*file_stream);
-            readTimer.stop();
-
             const float parsingTime = static_cast<float>(readTimer.get()) / 1000.f;
             std::cout << "\tparsing " << size_mb << "mb in " << parsingTime << " seconds [" << (size_mb / parsingTime) << " MBps]" << std::endl;
 
@@ -296,37 +960,28 @@ void loaders::load_PLY(Mesh *const mesh, const char *fileName, bool preload, boo
                 std::cout << "\tRead " << (tripstrip->buffer.size_bytes() / tinyply::PropertyTable[tripstrip->t].stride) << " total indices (tristrip) " << std::endl;
         }
 
-        std::vector<Vertex> vertices;
-        vertices.reserve(positions->count);
-        std::vector<unsigned int> indices;
-        indices.reserve(faces->count * 3);
+        Geometry geom;
 
         if (positions)
         {
             const float *posData = reinterpret_cast<const float *>(positions->buffer.get());
-            const float *normalData;
-            unsigned char *colorData;
-            const float *uvData;
-
-            if (normals)
-                normalData = reinterpret_cast<const float *>(normals->buffer.get());
-            if (colors)
-                colorData = reinterpret_cast<unsigned char *>(colors->buffer.get());
-            if (texcoords)
-                uvData = reinterpret_cast<const float *>(texcoords->buffer.get());
-
-            for (size_t i = 0; i < positions->count; i++)
-            {
-
+            const float *normalData = normals ? reinterpret_cast<const float *>(normals->buffer.get()) : nullptr;
+            const unsigned char *colorData = colors ? reinterpret_cast<const unsigned char *>(colors->buffer.get()) : nullptr;
+            const float *uvData = texcoords ? reinterpret_cast<const float *>(texcoords->buffer.get()) : nullptr;
+
+            // Every vertex is independent, convert them in parallel straight into place
+            geom.vertices.resize(positions->count);
+            utils::parallel_for(0, positions->count, [&](size_t i)
+                                {
                 // Position
                 float x = posData[i * 3];
                 float y = posData[i * 3 + 1];
                 float z = posData[i * 3 + 2];
 
                 // Normal
-                float nx = normals ? normalData[i * 3] : 0.0f;
-                float ny = normals ? normalData[i * 3 + 1] : 0.0f;
-                float nz = normals ? normalData[i * 3 + 2] : 0.0f;
+                float nx = normalData ? normalData[i * 3] : 0.0f;
+                float ny = normalData ? normalData[i * 3 + 1] : 0.0f;
+                float nz = normalData ? normalData[i * 3 + 2] : 0.0f;
 
                 // Vertex color
                 float r = colorData ? static_cast<float>(colorData[i * 4]) / 255 : 1.0f;
@@ -337,35 +992,24 @@ void loaders::load_PLY(Mesh *const mesh, const char *fileName, bool preload, boo
                 float u = uvData ? uvData[i * 2] : 0.0f;
                 float v = uvData ? uvData[i * 2 + 1] : 0.0f;
 
-                // Assuming Vertex has a constructor that takes position attributes
-                vertices.push_back({{x, y, z}, {nx, ny, nz}, {0.0f, 0.0f, 0.0f}, {u, v}, {r, g, b}}); // You can set color and other attributes as needed
-            }
+                geom.vertices[i] = {{x, y, z}, {nx, ny, nz}, {0.0f, 0.0f, 0.0f}, {u, v}, {r, g, b}}; });
         }
-        unsigned *facesData = reinterpret_cast<unsigned *>(faces->buffer.get());
-        for (size_t i = 0; i < faces->count; ++i)
+        if (faces)
         {
-
-            // Assuming faces are triangles, so we extract the vertex indices
-            unsigned int vertexIndex1 = static_cast<unsigned int>(facesData[i]);
-            unsigned int vertexIndex2 = static_cast<unsigned int>(facesData[i + 1]);
-            unsigned int vertexIndex3 = static_cast<unsigned int>(facesData[i + 2]);
-
-            indices.push_back(facesData[3 * i]);
-            indices.push_back(facesData[3 * i + 1]);
-            indices.push_back(facesData[3 * i + 2]);
+            // Faces are triangles, the index buffer is the face list itself
+            const unsigned int *facesData = reinterpret_cast<const unsigned int *>(faces->buffer.get());
+            geom.indices.assign(facesData, facesData + faces->count * 3);
         }
 
-        Geometry g;
-        g.vertices = vertices;
-        g.indices = indices;
-        mesh->set_geometry(g);
+        mesh->set_geometry(std::move(geom));
 
-        return;
+        return true;
     }
     catch (const std::exception &e)
     {
         std::cerr << "Caught tinyply exception: " << e.what() << std::endl;
     }
+    return false;
 }
 
 void loaders::load_image(Texture *const texture, const char *fileName, bool isPanorama)
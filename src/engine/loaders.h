@@ -5,6 +5,11 @@
 #include <thread>
 #include <unordered_map>
 #include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <sstream>
 #include <tiny_obj_loader.h>
 #include <tinyply.h>
 #include <stb_image.h>
@@ -15,9 +20,108 @@ GLIB_NAMESPACE_BEGIN
 
 namespace loaders
 {
-    void load_OBJ(Mesh *const mesh, const char *fileName, bool importMaterials = false, bool calculateTangents = false);
+    /*
+    Both return false if the file could not be read.
+    */
+    bool load_OBJ(Mesh *const mesh, const char *fileName, bool importMaterials = false, bool calculateTangents = false);
 
-    void load_PLY(Mesh *const mesh, const char *fileName, bool preload = true, bool verbose = false, bool calculateTangents = false);
+    bool load_PLY(Mesh *const mesh, const char *fileName, bool preload = true, bool verbose = false, bool calculateTangents = false);
+
+    /*
+    What a PLY file provided besides positions.
+    */
+    struct PLYInfo
+    {
+        bool normals{false};
+        bool colors{false};
+        bool texcoords{false};
+        bool faces{false};
+    };
+
+    /*
+    Reads PLY files made of a vertex element of scalar properties and optionally triangle faces, chunk by chunk.
+    Only the current chunk is held besides what the caller keeps, so peak memory stays bounded whatever the file size.
+    Binary little endian files need fixed size properties (float positions, normals and texcoords, uchar colors).
+    ASCII files, one element per line, take any numeric type and uchar or float colors. Their chunks are cut at line
+    boundaries and their numbers parsed with std::from_chars on every core.
+    */
+    class PLYStreamReader
+    {
+        std::ifstream m_file;
+        size_t m_chunkBytes;
+        bool m_supported{false};
+        bool m_ascii{false};
+        PLYInfo m_info{};
+
+        size_t m_vertexCount{0};
+        size_t m_faceCount{0};
+        size_t m_vertexStride{0}; // Bytes of a binary record, tokens of an ASCII line
+        // Property offsets within a binary vertex record
+        size_t m_position[3]{}, m_normal[3]{}, m_color[3]{}, m_uv[2]{};
+        // Attribute slot of every token of an ASCII vertex line, -1 for unused ones
+        std::vector<int8_t> m_tokenSlots;
+        float m_colorRange{255.0f}; // Color value standing for full intensity
+
+        size_t m_verticesRead{0};
+        size_t m_facesRead{0};
+        std::vector<uint8_t> m_chunk; // Raw records or text of the current chunk
+        size_t m_textSize{0};         // Text in the chunk, what the last chunk left first
+
+        /*
+        Tops the chunk up with text up to its size and returns how much of it are whole lines. A missing last
+        line break is added at the end of the file.
+        */
+        size_t read_text();
+
+        /*
+        Drops the first bytes of text, keeping the rest for the next chunk.
+        */
+        void consume_text(size_t bytes);
+
+        size_t read_ascii_vertices(std::vector<Vertex> &vertices, const Vertex &defaults);
+
+        size_t read_ascii_faces(std::vector<unsigned int> &indices);
+
+    public:
+        static constexpr size_t DEFAULT_CHUNK_BYTES = size_t(64) << 20;
+
+        /*
+        chunkBytes bounds the memory of a chunk, raw records and converted vertices together.
+        */
+        PLYStreamReader(const char *fileName, size_t chunkBytes = DEFAULT_CHUNK_BYTES);
+
+        /*
+        False if the file is missing or has any other layout, then nothing can be read.
+        */
+        inline bool is_supported() const { return m_supported; }
+
+        inline const PLYInfo &get_info() const { return m_info; }
+
+        inline size_t get_vertex_count() const { return m_vertexCount; }
+
+        inline size_t get_face_count() const { return m_faceCount; }
+
+        /*
+        Converts the next chunk of vertices in parallel and appends them to vertices. Attributes missing from the
+        file are taken from defaults. Returns the number of vertices read, 0 once all of them are.
+        */
+        size_t read_vertices(std::vector<Vertex> &vertices, const Vertex &defaults);
+
+        /*
+        Once every vertex is read, appends the indices of the next chunk of triangles to indices. Returns the number
+        of faces read, 0 once all of them are. A face that is not a triangle stops the reader, which is no longer
+        supported then.
+        */
+        size_t read_faces(std::vector<unsigned int> &indices);
+    };
+
+    /*
+    Fast path for the layouts PLYStreamReader handles. Attributes are converted in parallel, chunk by chunk, straight
+    into the vertices of g. Attributes missing from the file are taken from defaults.
+    Returns false, leaving g untouched, for any other layout so the caller can fall back to tinyply.
+    */
+    bool load_PLY_fast(const char *fileName, Geometry &g, const Vertex &defaults, PLYInfo *info = nullptr,
+                         size_t chunkBytes = PLYStreamReader::DEFAULT_CHUNK_BYTES);
 
     void load_image(Texture* const texture, const char *fileName, bool isPanorama = false);
     
@@ -1,17 +1,34 @@
+#include <algorithm>
 #include "mesh.h"
 
 GLIB_NAMESPACE_BEGIN
 
 int Mesh::INSTANCED_MESHES = 0;
 
-void Mesh::set_geometry(Geometry &g)
+void Mesh::set_geometry(Geometry &&g)
 {
-    m_geometry = g;
+    m_geometry = std::move(g);
     m_geometry_loaded = true;
+    m_geometry_released = false;
+}
+void Mesh::take_geometry_from(Mesh *const source)
+{
+    if (!source->m_geometry_loaded)
+        return;
+
+    set_geometry(std::move(source->m_geometry));
+    source->m_geometry = Geometry{};
+    source->m_geometry_loaded = false;
+
+    if (source->m_bv)
+    {
+        set_bounding_volume(source->m_bv);
+        source->m_bv = nullptr;
+    }
 }
 void Mesh::generate_buffers()
 {
-    if (!m_geometry_loaded)
+    if (!m_geometry_loaded || m_stream.enabled)
         return;
 
     GL_CHECK(glGenVertexArrays(1, &m_vao));
@@ -23,11 +40,69 @@ void Mesh::generate_buffers()
     // -------------------- [ATTENTION ATTENTION] ---------------------
     //  ------------------  INTERLEAVED ATTRIBUTES  --------------------
 
-    unsigned int vbo;
-    GL_CHECK(glGenBuffers(1, &vbo));
-    GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, vbo));
+    GL_CHECK(glGenBuffers(1, &m_vbo));
+    GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, m_vbo));
     GL_CHECK(glBufferData(GL_ARRAY_BUFFER, vertexSize * m_geometry.vertices.size(), m_geometry.vertices.data(), GL_STATIC_DRAW));
 
+    setup_vertex_attributes();
+
+    if (!m_geometry.indices.empty())
+    {
+        ASSERT(sizeof(GLuint) == sizeof(unsigned int));
+        GL_CHECK(glGenBuffers(1, &m_ibo));
+        GL_CHECK(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo));
+        GL_CHECK(glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_geometry.indices.size() * sizeof(m_geometry.indices[0]), m_geometry.indices.data(), GL_STATIC_DRAW));
+
+        m_geometry.indexed = true;
+    }
+    else
+        m_geometry.indexed = false;
+
+    GL_CHECK(glBindVertexArray(0));
+    m_buffer_loaded = true;
+    m_vertexCount = m_geometry.vertices.size();
+    m_indexCount = m_geometry.indices.size();
+
+    release_geometry();
+}
+
+void Mesh::release_geometry()
+{
+    if (m_residency != GeometryResidency::RELEASE_AFTER_UPLOAD)
+        return;
+
+    // The bounding volume can not be computed anymore afterwards
+    if (!m_bv)
+        setup_bounding_volume();
+
+    const bool indexed = m_geometry.indexed;
+    m_geometry = Geometry{};
+    m_geometry.indexed = indexed;
+    m_geometry_released = true;
+}
+
+void Mesh::read_back_geometry()
+{
+    if (!m_geometry_released || !m_buffer_loaded)
+        return;
+
+    m_geometry.vertices.resize(m_vertexCount);
+    GL_CHECK(glBindBuffer(GL_COPY_READ_BUFFER, m_vbo));
+    GL_CHECK(glGetBufferSubData(GL_COPY_READ_BUFFER, 0, m_vertexCount * sizeof(Vertex), m_geometry.vertices.data()));
+    if (m_indexCount > 0)
+    {
+        m_geometry.indices.resize(m_indexCount);
+        GL_CHECK(glBindBuffer(GL_COPY_READ_BUFFER, m_ibo));
+        GL_CHECK(glGetBufferSubData(GL_COPY_READ_BUFFER, 0, m_indexCount * sizeof(unsigned int), m_geometry.indices.data()));
+    }
+    GL_CHECK(glBindBuffer(GL_COPY_READ_BUFFER, 0));
+    m_geometry_released = false;
+}
+
+void Mesh::setup_vertex_attributes()
+{
+    size_t vertexSize = sizeof(Vertex);
+
     // Position attribute
     GL_CHECK(glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, vertexSize, (void *)0));
     GL_CHECK(glEnableVertexAttribArray(0));
@@ -43,24 +118,53 @@ void Mesh::generate_buffers()
     // Color attribute
     GL_CHECK(glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)(11 * sizeof(float))));
     GL_CHECK(glEnableVertexAttribArray(4));
+}
 
-    if (!m_geometry.indices.empty())
-    {
-        ASSERT(sizeof(GLuint) == sizeof(unsigned int));
-        unsigned int ibo;
-        GL_CHECK(glGenBuffers(1, &ibo));
-        GL_CHECK(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo));
-        GL_CHECK(glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_geometry.indices.size() * sizeof(m_geometry.indices[0]), m_geometry.indices.data(), GL_STATIC_DRAW));
+#pragma region STREAMING
 
-        m_geometry.indexed = true;
+void Mesh::enable_streaming(size_t uploadBudget, size_t vertexHint)
+{
+    m_stream.enabled = true;
+    m_stream.uploadBudget = uploadBudget;
+    // The hint is only reserved once the GL objects get created on the GL thread
+    m_stream.vertexCapacity = vertexHint;
+}
+
+bool Mesh::grow_buffer(unsigned int &buffer, size_t &capacity, size_t required, size_t usedBytes, size_t elementSize)
+{
+    if (buffer != 0 && required <= capacity)
+        return false;
+
+    const size_t newCapacity = std::max({required, capacity * 2, (size_t)1});
+    unsigned int newBuffer;
+    GL_CHECK(glGenBuffers(1, &newBuffer));
+    GL_CHECK(glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer));
+    GL_CHECK(glBufferData(GL_COPY_WRITE_BUFFER, newCapacity * elementSize, nullptr, GL_STATIC_DRAW));
+    if (buffer != 0)
+    {
+        if (usedBytes > 0)
+        {
+            GL_CHECK(glBindBuffer(GL_COPY_READ_BUFFER, buffer));
+            GL_CHECK(glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, usedBytes));
+        }
+        GL_CHECK(glDeleteBuffers(1, &buffer));
     }
-    else
-        m_geometry.indexed = false;
+    buffer = newBuffer;
+    capacity = newCapacity;
+    return true;
+}
 
-    GL_CHECK(glBindVertexArray(0));
-    m_buffer_loaded = true;
+void Mesh::upload_streamed_batches()
+{
+    if (!m_stream.enabled)
+        return;
+
+    if (Volume *bv = m_stream.volume.exchange(nullptr, std::memory_order_acquire))
+        set_bounding_volume(bv);
 }
 
+#pragma endregion
+
 void Mesh::draw(bool useMaterial, unsigned int drawingPrimitive)
 {
     if (m_enabled && m_buffer_loaded)
@@ -75,12 +179,12 @@ void Mesh::draw(bool useMaterial, unsigned int drawingPrimitive)
 
         if (m_geometry.indexed == true)
         {
-            GL_CHECK(glDrawElements(drawingPrimitive, m_geometry.indices.size(), GL_UNSIGNED_INT, (void *)0));
+            GL_CHECK(glDrawElements(drawingPrimitive, m_indexCount, GL_UNSIGNED_INT, (void *)0));
         }
         else
         {
 
-            GL_CHECK(glDrawArrays(drawingPrimitive, 0, m_geometry.vertices.size()));
+            GL_CHECK(glDrawArrays(drawingPrimitive, 0, m_vertexCount));
         }
 
         if (m_material && useMaterial)
@@ -92,6 +196,44 @@ void Mesh::draw(bool useMaterial, unsigned int drawingPrimitive)
         generate_buffers();
 }
 
+void Mesh::draw_procedural(size_t vertexCount, bool useMaterial, unsigned int drawingPrimitive)
+{
+    if (!m_enabled || vertexCount == 0)
+        return;
+
+    if (m_material && useMaterial)
+    {
+        m_material->bind();
+    }
+
+    bind_empty_vertex_array();
+    GL_CHECK(glDrawArrays(drawingPrimitive, 0, vertexCount));
+    GL_CHECK(glBindVertexArray(0));
+
+    if (m_material && useMaterial)
+    {
+        m_material->unbind();
+    }
+}
+
+void Mesh::bind_empty_vertex_array()
+{
+    // Core profile refuses draws without a vertex array, even if it has no attributes
+    if (!m_emptyVao)
+    {
+        GL_CHECK(glGenVertexArrays(1, &m_emptyVao));
+    }
+    GL_CHECK(glBindVertexArray(m_emptyVao));
+}
+
+void Mesh::bind_vertex_storage(unsigned int binding) const
+{
+    if (m_buffer_loaded)
+    {
+        GL_CHECK(glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, m_vbo));
+    }
+}
+
 Mesh *Mesh::create_screen_quad()
 {
     Mesh *screen = new Mesh();
@@ -101,7 +243,7 @@ Mesh *Mesh::create_screen_quad()
                          {{-1.0f, 1.0f, 0.0f}, {0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f}, {0.0f, 1.0f}, {0.0f, 0.0f, 0.0f}},
                          {{1.0f, 1.0f, 0.0f}, {0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f}, {1.0f, 1.0f}, {0.0f, 0.0f, 0.0f}}};
     geometry.indices = {0, 1, 2, 1, 3, 2};
-    screen->set_geometry(geometry);
+    screen->set_geometry(std::move(geometry));
     screen->generate_buffers();
     return screen;
 }
@@ -139,7 +281,7 @@ Mesh *Mesh::create_cube()
         2, 3, 7,
         7, 6, 2};
 
-    cube->set_geometry(geometry);
+    cube->set_geometry(std::move(geometry));
     cube->generate_buffers();
     return cube;
 }
@@ -177,7 +319,7 @@ Mesh *Mesh::create_strand()
         2, 3, 7,
         7, 6, 2};
 
-    cube->set_geometry(geometry);
+    cube->set_geometry(std::move(geometry));
     cube->generate_buffers();
     return cube;
 }
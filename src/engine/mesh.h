@@ -30,10 +30,10 @@ struct Vertex
 
 struct Geometry
 {
-    size_t triangles;
+    size_t triangles{0};
     std::vector<Vertex> vertices;
     std::vector<unsigned int> indices;
-    bool indexed;
+    bool indexed{false};
 };
 
 #pragma region BV
@@ -43,6 +43,7 @@ Bounding volume base struct
 */
 struct Volume
 {
+    virtual ~Volume() = default;
     virtual void setup(Geometry *const g) = 0;
 };
 struct Sphere : public Volume
@@ -64,10 +65,22 @@ struct AABB : public Volume
 #pragma endregion
 #pragma region MESH
 
+/*
+What happens to the CPU copy of a mesh geometry once it is on the GPU.
+*/
+enum class GeometryResidency
+{
+    KEEP,                // Stays in memory, e.g. for meshes sampled by loaders
+    RELEASE_AFTER_UPLOAD // Freed after upload, it can still be read back from the GPU buffers
+};
+
 class Mesh : public Object3D
 {
 protected:
     unsigned int m_vao;
+    unsigned int m_vbo{0};
+    unsigned int m_ibo{0};
+    unsigned int m_emptyVao{0}; // Attribute-less draws
 
     Geometry m_geometry;
     Material *m_material;
@@ -77,24 +90,97 @@ protected:
     bool m_geometry_loaded{false};
     bool m_buffer_loaded{false};
 
+    GeometryResidency m_residency{GeometryResidency::KEEP};
+    bool m_geometry_released{false};
+    // Elements on the GPU, the CPU copy may have been released
+    size_t m_vertexCount{0};
+    size_t m_indexCount{0};
+
     static int INSTANCED_MESHES;
 
+    /*
+    Progressive upload state shared by the streaming meshes. The batch queue and its format belong to the subclass.
+    */
+    struct StreamState
+    {
+        bool enabled{false};
+        size_t uploadBudget{0}; // Bytes per frame
+        size_t vertexCapacity{0};
+        size_t uploadedVertices{0}; // Of the batch being uploaded
+
+        std::atomic<Volume *> volume{nullptr}; // Handed over by the loader, applied on the GL thread
+    };
+    StreamState m_stream{};
+
+    void setup_vertex_attributes();
+
+    /*
+    Frees the CPU copy if the residency policy asks for it. Called once the geometry is on the GPU.
+    */
+    virtual void release_geometry();
+
+    /*
+    Makes sure buffer holds at least required elements, keeping its first usedBytes. Capacity at least doubles to
+    amortize copies. Returns whether the buffer was replaced.
+    */
+    static bool grow_buffer(unsigned int &buffer, size_t &capacity, size_t required, size_t usedBytes, size_t elementSize);
+
+    /*
+    Binds the vertex array of attribute-less draws, created on first use.
+    */
+    void bind_empty_vertex_array();
+
 public:
     Mesh() : Object3D("Mesh", {0.0f, 0.0f, 0.0f}, Object3DType::MESH), m_material(nullptr) { Mesh::INSTANCED_MESHES++; }
-    Mesh(Geometry &geometry, Material *const material) : Object3D("Mesh", {0.0f, 0.0f, 0.0f}, Object3DType::MESH), m_material(material), m_geometry(geometry) { Mesh::INSTANCED_MESHES++; }
+    Mesh(Geometry &&geometry, Material *const material) : Object3D("Mesh", {0.0f, 0.0f, 0.0f}, Object3DType::MESH), m_geometry(std::move(geometry)), m_material(material), m_geometry_loaded(true) { Mesh::INSTANCED_MESHES++; }
     ~Mesh()
     {
         Mesh::INSTANCED_MESHES--;
         cleanup();
         delete m_material;
+        delete m_bv;
+        delete m_stream.volume.load();
     }
 
     inline unsigned int get_buffer_id() const { return m_vao; }
     inline bool is_buffer_loaded() const { return m_buffer_loaded; }
 
-    void set_geometry(Geometry &g);
+    /*
+    Takes ownership of the geometry buffers. Pass a copy explicitly if the caller needs to keep its own.
+    */
+    void set_geometry(Geometry &&g);
+
+    /*
+    CPU copy of the geometry. Empty once uploaded if the mesh releases it, see read_back_geometry().
+    */
+    inline const Geometry &get_geometry() const { return m_geometry; }
+
+    inline bool is_geometry_loaded() const { return m_geometry_loaded; }
+
+    inline void set_geometry_residency(GeometryResidency residency) { m_residency = residency; }
+
+    inline GeometryResidency get_geometry_residency() const { return m_residency; }
+
+    /*
+    Whether the CPU copy is in memory, it is not after upload if the mesh releases it.
+    */
+    inline bool is_geometry_resident() const { return m_geometry_loaded && !m_geometry_released; }
+
+    /*
+    GL thread only. Restores a released CPU copy from the GPU buffers. Does nothing if it is still resident.
+    */
+    virtual void read_back_geometry();
 
-    inline Geometry get_geometry() const { return m_geometry; }
+    /*
+    Vertices on the GPU. For streaming meshes it only counts fully uploaded batches.
+    */
+    inline size_t get_vertex_count() const { return m_vertexCount; }
+
+    /*
+    Moves the geometry and bounding volume out of source, leaving it empty. Used to hand meshes
+    loaded off-thread over to the one being drawn.
+    */
+    void take_geometry_from(Mesh *const source);
 
     inline void set_material(Material *const material) { m_material = material; }
 
@@ -102,13 +188,59 @@ public:
 
     virtual void generate_buffers();
 
+#pragma region STREAMING
+    /*
+    Switch the mesh to streaming mode. Only meshes with a batch queue (HairMesh) stream, geometry is then fed
+    through their push_batch() and becomes visible batch by batch.
+    The capacity hint (in vertices) lets the GPU buffer be allocated once if the final size is known.
+    */
+    void enable_streaming(size_t uploadBudget, size_t vertexHint = 0);
+
+    inline bool is_streaming() const { return m_stream.enabled; }
+
+    inline void set_stream_budget(size_t uploadBudget) { m_stream.uploadBudget = uploadBudget; }
+
+    /*
+    Thread safe. Takes ownership of the volume, which replaces the current one on the next upload_streamed_batches().
+    */
+    inline void push_bounding_volume(Volume *bv) { delete m_stream.volume.exchange(bv, std::memory_order_release); }
+
+    /*
+    GL thread only, call once per frame. Uploads queued batches until the per frame budget is spent.
+    The base only applies the pushed bounding volume.
+    */
+    virtual void upload_streamed_batches();
+#pragma endregion
+
     virtual void draw(bool useMaterial = true, unsigned int drawingPrimitive = GL_TRIANGLES);
 
+    /*
+    Draws vertexCount vertices with the mesh material but no vertex attributes. The vertex shader builds them
+    from gl_VertexID, typically reading storage buffers.
+    */
+    void draw_procedural(size_t vertexCount, bool useMaterial = true, unsigned int drawingPrimitive = GL_TRIANGLES);
+
+    /*
+    Exposes the vertex buffer to shaders as a storage buffer on binding. Vertices are tightly packed Vertex structs
+    (StrandVertex for hair meshes).
+    */
+    virtual void bind_vertex_storage(unsigned int binding) const;
+
     inline static int get_number_of_instances() { return INSTANCED_MESHES; }
 
     inline void cleanup()
     {
+        if (m_emptyVao)
+        {
+            GL_CHECK(glDeleteVertexArrays(1, &m_emptyVao));
+            m_emptyVao = 0;
+        }
+        // Meshes used as loading targets on worker threads never own GL objects
+        if (!m_buffer_loaded)
+            return;
         GL_CHECK(glDeleteVertexArrays(1, &m_vao));
+        GL_CHECK(glDeleteBuffers(1, &m_vbo));
+        GL_CHECK(glDeleteBuffers(1, &m_ibo));
     }
 
     inline void setup_bounding_volume()
@@ -119,6 +251,15 @@ public:
         m_bv->setup(&m_geometry);
     }
 
+    /*
+    Takes ownership of an already computed volume (e.g. restored from a cache) instead of scanning the geometry.
+    */
+    inline void set_bounding_volume(Volume *bv)
+    {
+        delete m_bv;
+        m_bv = bv;
+    }
+
     inline Volume *get_bounding_volume() const { return m_bv; }
 
     /*
@@ -81,7 +81,7 @@ public:
         m_transform.position = glm::vec3(0.0f);
     }
 
-    ~Object3D()
+    virtual ~Object3D()
     {
         // delete[] children;
         delete m_parent;
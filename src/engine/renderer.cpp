@@ -63,6 +63,8 @@ void Renderer::tick()
         m_time.last = currentTime;
         m_time.framerate = int(1.0 / m_time.delta);
 
+        m_loader.process_completed();
+
         update();
 
         if (m_settings.userInterface)
@@ -124,6 +126,8 @@ void Renderer::upload_user_interface_render_data()
 
 void Renderer::cleanup()
 {
+    m_loader.shutdown();
+
     if (!m_cleanupQueue.functions.empty())
         m_cleanupQueue.flush();
 
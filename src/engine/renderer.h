@@ -4,6 +4,7 @@
 #include "core.h"
 #include "utils.h"
 #include "framebuffer.h"
+#include "asset_loader.h"
 
 GLIB_NAMESPACE_BEGIN
 
@@ -65,6 +66,8 @@ protected:
 
     utils::EventDispatcher m_cleanupQueue;
 
+    AssetLoader m_loader{};
+
     void create_context();
     void tick();
     void cleanup();
@@ -252,6 +252,19 @@ ShaderStageSource Shader::parse_shader(const char *filename)
                 type = StageType::TESS_EVAL;
             }
         }
+        else if (line.rfind("#include", 0) == 0)
+        {
+            // Shared snippets, resolved relative to the including file
+            const size_t open = line.find('"');
+            const size_t close = line.find('"', open + 1);
+            if (open == std::string::npos || close == std::string::npos)
+            {
+                ERR_LOG("Malformed include in " << file << ": " << line);
+                continue;
+            }
+            const std::filesystem::path include = std::filesystem::path(file).parent_path() / line.substr(open + 1, close - open - 1);
+            ss[(int)type] << Shader::parse_shader_stage(include.string().c_str());
+        }
         else
         {
             ss[(int)type] << line << '\n';
@@ -12,6 +12,7 @@
 #define __SHADER__
 
 #include <unordered_map>
+#include <filesystem>
 #include <sstream>
 #include <fstream>
 #include <vector>
@@ -107,7 +108,7 @@ public:
     static std::string parse_shader_stage(const char *filename);
 
     /*
-    Parse .glsl file.
+    Parse .glsl file. Lines like #include "file" are replaced by the contents of that file, relative to the .glsl one.
     */
     static ShaderStageSource parse_shader(const char *filename);
 };
@@ -53,7 +53,7 @@ struct Image
 class Texture
 {
 protected:
-    unsigned int m_id;
+    unsigned int m_id{0};
 
     Extent2D m_extent{};
 
@@ -104,7 +104,8 @@ public:
 
     inline void cleanup()
     {
-        GL_CHECK(glDeleteTextures(1, &m_id));
+        if (m_generated)
+            GL_CHECK(glDeleteTextures(1, &m_id));
     }
 
     void generate_mipmaps();
@@ -0,0 +1,342 @@
+#ifndef __THREAD_POOL__
+#define __THREAD_POOL__
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+Kept free of engine and GL dependencies so standalone tools (e.g. the LUT generator) can include it
+directly. The engine gets it through utils.h.
+*/
+namespace glib
+{
+    namespace utils
+    {
+        /*
+        Set of tasks that can be waited on. Waiting runs pending pool work instead of blocking, so tasks
+        can spawn and wait on nested work. The first exception thrown by a task is rethrown by wait().
+        */
+        class TaskGroup
+        {
+            friend class ThreadPool;
+
+            std::atomic<size_t> m_pending{0};
+            std::exception_ptr m_error{nullptr};
+            std::mutex m_errorMutex;
+
+        public:
+            inline bool done() const { return m_pending.load(std::memory_order_acquire) == 0; }
+        };
+
+        /*
+        Work stealing thread pool. Every worker owns a deque: it pushes and pops its own work at the back
+        while idle workers steal from the front of the others, which balances uneven work without a
+        shared queue. Work submitted from outside the pool is spread round robin across the deques.
+        */
+        class ThreadPool
+        {
+            struct Task
+            {
+                std::function<void()> function;
+                TaskGroup *group;
+            };
+            struct Queue
+            {
+                std::deque<Task> tasks;
+                std::mutex mutex;
+            };
+
+            std::vector<std::unique_ptr<Queue>> m_queues;
+            std::vector<std::thread> m_threads;
+
+            std::atomic<size_t> m_queued{0};
+            std::atomic<size_t> m_nextQueue{0};
+            std::mutex m_sleepMutex;
+            std::condition_variable m_wake;
+            bool m_stop{false};
+
+            struct ThreadContext
+            {
+                const ThreadPool *pool{nullptr};
+                size_t queue{0};
+            };
+            static ThreadContext &context()
+            {
+                static thread_local ThreadContext ctx;
+                return ctx;
+            }
+
+            /*
+            Index of the calling worker's queue, or a round robin one for outside threads.
+            */
+            inline size_t home_queue()
+            {
+                const ThreadContext &ctx = context();
+                if (ctx.pool == this)
+                    return ctx.queue;
+                return m_nextQueue.fetch_add(1, std::memory_order_relaxed) % m_queues.size();
+            }
+
+            bool try_pop(size_t home, Task &task)
+            {
+                {
+                    Queue &own = *m_queues[home];
+                    std::lock_guard<std::mutex> lock(own.mutex);
+                    if (!own.tasks.empty())
+                    {
+                        task = std::move(own.tasks.back());
+                        own.tasks.pop_back();
+                        return true;
+                    }
+                }
+                for (size_t i = 1; i < m_queues.size(); i++)
+                {
+                    Queue &victim = *m_queues[(home + i) % m_queues.size()];
+                    std::lock_guard<std::mutex> lock(victim.mutex);
+                    if (!victim.tasks.empty())
+                    {
+                        task = std::move(victim.tasks.front());
+                        victim.tasks.pop_front();
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            bool run_one(size_t home)
+            {
+                Task task;
+                if (!try_pop(home, task))
+                    return false;
+                m_queued.fetch_sub(1, std::memory_order_relaxed);
+
+                try
+                {
+                    task.function();
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock(task.group->m_errorMutex);
+                    if (!task.group->m_error)
+                        task.group->m_error = std::current_exception();
+                }
+                task.group->m_pending.fetch_sub(1, std::memory_order_acq_rel);
+                return true;
+            }
+
+            void worker_loop(size_t index)
+            {
+                context() = {this, index};
+                for (;;)
+                {
+                    if (run_one(index))
+                        continue;
+
+                    std::unique_lock<std::mutex> lock(m_sleepMutex);
+                    m_wake.wait(lock, [this]
+                                { return m_stop || m_queued.load(std::memory_order_relaxed) > 0; });
+                    if (m_stop && m_queued.load(std::memory_order_relaxed) == 0)
+                        return;
+                }
+            }
+
+        public:
+            ThreadPool(size_t threads = std::thread::hardware_concurrency())
+            {
+                threads = std::max<size_t>(1, threads);
+                for (size_t i = 0; i < threads; i++)
+                    m_queues.emplace_back(new Queue());
+                for (size_t i = 0; i < threads; i++)
+                    m_threads.emplace_back(&ThreadPool::worker_loop, this, i);
+            }
+            ~ThreadPool()
+            {
+                {
+                    std::lock_guard<std::mutex> lock(m_sleepMutex);
+                    m_stop = true;
+                }
+                m_wake.notify_all();
+                for (std::thread &t : m_threads)
+                    t.join();
+            }
+
+            ThreadPool(const ThreadPool &) = delete;
+            ThreadPool &operator=(const ThreadPool &) = delete;
+
+            /*
+            Process wide pool sized to the hardware concurrency.
+            */
+            static ThreadPool &global()
+            {
+                static ThreadPool pool;
+                return pool;
+            }
+
+            inline size_t size() const { return m_threads.size(); }
+
+            void submit(TaskGroup &group, std::function<void()> function)
+            {
+                group.m_pending.fetch_add(1, std::memory_order_relaxed);
+                // Counted before it is visible, so the counter never drops below the tasks in the queues
+                m_queued.fetch_add(1, std::memory_order_relaxed);
+                {
+                    Queue &queue = *m_queues[home_queue()];
+                    std::lock_guard<std::mutex> lock(queue.mutex);
+                    queue.tasks.push_back({std::move(function), &group});
+                }
+
+                // Taking the lock orders the increment with a worker checking it before sleeping
+                {
+                    std::lock_guard<std::mutex> lock(m_sleepMutex);
+                }
+                m_wake.notify_one();
+            }
+
+            /*
+            Helps running pool work until every task of the group is finished.
+            */
+            void wait(TaskGroup &group)
+            {
+                const ThreadContext &ctx = context();
+                const size_t home = ctx.pool == this ? ctx.queue : 0;
+                while (!group.done())
+                {
+                    if (!run_one(home))
+                        std::this_thread::yield();
+                }
+
+                if (group.m_error)
+                {
+                    std::exception_ptr error = group.m_error;
+                    group.m_error = nullptr;
+                    std::rethrow_exception(error);
+                }
+            }
+
+            /*
+            Calls body(chunkBegin, chunkEnd) over [begin, end) split in chunks of grain elements.
+            With grain 0 the range is cut in a few chunks per thread.
+            */
+            template <typename F>
+            void parallel_for_range(size_t begin, size_t end, F &&body, size_t grain = 0)
+            {
+                if (begin >= end)
+                    return;
+
+                const size_t count = end - begin;
+                if (grain == 0)
+                    grain = std::max<size_t>(1, count / (4 * size()));
+                if (count <= grain)
+                {
+                    body(begin, end);
+                    return;
+                }
+
+                TaskGroup group;
+                for (size_t chunk = begin; chunk < end; chunk += grain)
+                {
+                    const size_t chunkEnd = std::min(chunk + grain, end);
+                    submit(group, [&body, chunk, chunkEnd]
+                           { body(chunk, chunkEnd); });
+                }
+                wait(group);
+            }
+
+            /*
+            Calls body(i) for every i in [begin, end).
+            */
+            template <typename F>
+            void parallel_for(size_t begin, size_t end, F &&body, size_t grain = 0)
+            {
+                parallel_for_range(begin, end, [&body](size_t chunkBegin, size_t chunkEnd)
+                                   {
+                    for (size_t i = chunkBegin; i < chunkEnd; i++)
+                        body(i); },
+                                   grain);
+            }
+        };
+
+        /*
+        Shorthands running on the global pool.
+        */
+        template <typename F>
+        inline void parallel_for(size_t begin, size_t end, F &&body, size_t grain = 0)
+        {
+            ThreadPool::global().parallel_for(begin, end, std::forward<F>(body), grain);
+        }
+        template <typename F>
+        inline void parallel_for_range(size_t begin, size_t end, F &&body, size_t grain = 0)
+        {
+            ThreadPool::global().parallel_for_range(begin, end, std::forward<F>(body), grain);
+        }
+
+        /*
+        Tasks with dependencies between them. A task is scheduled as soon as all the tasks it depends on
+        are finished. The graph can be run several times.
+        */
+        class TaskGraph
+        {
+            struct Node
+            {
+                std::function<void()> function;
+                std::vector<size_t> successors;
+                size_t dependencies{0};
+                std::atomic<size_t> remaining{0};
+            };
+            std::vector<std::unique_ptr<Node>> m_nodes;
+
+            void schedule(ThreadPool &pool, TaskGroup &group, size_t id)
+            {
+                pool.submit(group, [this, &pool, &group, id]
+                            {
+                    Node &node = *m_nodes[id];
+                    node.function();
+                    for (size_t next : node.successors)
+                        if (m_nodes[next]->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                            schedule(pool, group, next); });
+            }
+
+        public:
+            /*
+            Returns the id of the new task. Dependencies must be ids of tasks already added.
+            */
+            size_t add(std::function<void()> function, std::initializer_list<size_t> dependencies = {})
+            {
+                const size_t id = m_nodes.size();
+                m_nodes.emplace_back(new Node());
+                m_nodes.back()->function = std::move(function);
+                m_nodes.back()->dependencies = dependencies.size();
+                for (size_t dep : dependencies)
+                    m_nodes[dep]->successors.push_back(id);
+                return id;
+            }
+
+            /*
+            Runs the whole graph and waits for it. If a task throws, the tasks depending on it are skipped
+            and the exception is rethrown here.
+            */
+            void run(ThreadPool &pool = ThreadPool::global())
+            {
+                for (std::unique_ptr<Node> &node : m_nodes)
+                    node->remaining = node->dependencies;
+
+                TaskGroup group;
+                for (size_t id = 0; id < m_nodes.size(); id++)
+                    if (m_nodes[id]->dependencies == 0)
+                        schedule(pool, group, id);
+                pool.wait(group);
+            }
+        };
+    }
+}
+
+#endif
@@ -1,4 +1,5 @@
 #include "uniforms.h"
+#include <algorithm>
 
 GLIB_NAMESPACE_BEGIN
 
@@ -25,6 +26,18 @@ void UniformBuffer::cache_data(const size_t sizeInBytes, const void *data, const
     GL_CHECK(glBindBuffer(GL_UNIFORM_BUFFER, 0));
 }
 
+void UniformBuffer::bind_range(const size_t offset, const size_t bytes) const
+{
+    GL_CHECK(glBindBufferRange(GL_UNIFORM_BUFFER, m_layoutBinding, m_id, offset, bytes));
+}
+
+size_t UniformBuffer::get_offset_alignment()
+{
+    GLint alignment = 0;
+    GL_CHECK(glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment));
+    return std::max<size_t>(alignment, 1);
+}
+
 void UniformBuffer::bind() const
 {
     GL_CHECK(glBindBuffer(GL_UNIFORM_BUFFER, m_id));
@@ -35,4 +48,25 @@ void UniformBuffer::unbind() const
     GL_CHECK(glBindBuffer(GL_UNIFORM_BUFFER, 0));
 }
 
+void StorageBuffer::generate(const void *data)
+{
+    GL_CHECK(glGenBuffers(1, &m_id));
+    GL_CHECK(glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_id));
+    GL_CHECK(glBufferData(GL_SHADER_STORAGE_BUFFER, BYTES, data, GL_STATIC_DRAW));
+    GL_CHECK(glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0));
+    m_generated = true;
+}
+
+void StorageBuffer::bind() const
+{
+    GL_CHECK(glBindBufferBase(GL_SHADER_STORAGE_BUFFER, m_binding, m_id));
+}
+
+void StorageBuffer::cache_data(const size_t sizeInBytes, const void *data, const size_t offset) const
+{
+    GL_CHECK(glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_id));
+    GL_CHECK(glBufferSubData(GL_SHADER_STORAGE_BUFFER, offset, sizeInBytes, data));
+    GL_CHECK(glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0));
+}
+
 GLIB_NAMESPACE_END
@@ -40,6 +40,56 @@ public:
 
     void cache_data(const size_t sizeInBytes, const void *data, const size_t offset = 0) const;
 
+    /*
+    Attaches only bytes from offset on to the layout binding, for buffers holding one block per object. The offset
+    has to be a multiple of get_offset_alignment().
+    */
+    void bind_range(const size_t offset, const size_t bytes) const;
+
+    /*
+    GL thread only. Alignment the driver requires for offsets of bound ranges.
+    */
+    static size_t get_offset_alignment();
+
+    inline bool is_generated() const { return m_generated; }
+};
+
+/*
+Shader storage buffer attached to a fixed binding point. Meant for large data sets that shaders index on their own.
+*/
+class StorageBuffer
+{
+    unsigned int m_id{0};
+    const size_t BYTES;
+    size_t m_binding;
+
+    bool m_generated{false};
+
+public:
+    StorageBuffer(const size_t sizeInBytes, const size_t binding = 0) : BYTES(sizeInBytes), m_binding(binding){};
+
+    ~StorageBuffer()
+    {
+        if (m_generated)
+        {
+            GL_CHECK(glDeleteBuffers(1, &m_id))
+        }
+    }
+
+    /*
+    Allocates the buffer, filled with data if given.
+    */
+    void generate(const void *data = nullptr);
+
+    /*
+    Attaches the buffer to its binding point.
+    */
+    void bind() const;
+
+    void cache_data(const size_t sizeInBytes, const void *data, const size_t offset = 0) const;
+
+    inline size_t get_size() const { return BYTES; }
+
     inline bool is_generated() const { return m_generated; }
 };
 
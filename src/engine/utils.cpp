@@ -1,10 +1,116 @@
 #include "utils.h"
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 GLIB_NAMESPACE_BEGIN
 
+std::vector<uint32_t> utils::morton_order(const std::vector<glm::vec3> &points)
+{
+    std::vector<uint32_t> order(points.size());
+    if (points.empty())
+        return order;
+
+    glm::vec3 minCoords = points.front();
+    glm::vec3 maxCoords = points.front();
+    for (const glm::vec3 &p : points)
+    {
+        minCoords = glm::min(minCoords, p);
+        maxCoords = glm::max(maxCoords, p);
+    }
+    // Same scale on every axis, so the curve does not stretch along the thin ones
+    const float extent = std::max(std::max(maxCoords.x - minCoords.x, maxCoords.y - minCoords.y), maxCoords.z - minCoords.z);
+    const float scale = extent > 0.0f ? float((1u << 21) - 1) / extent : 0.0f;
+
+    std::vector<std::pair<uint64_t, uint32_t>> keys(points.size());
+    parallel_for(0, points.size(), [&](size_t i)
+                 {
+        const glm::uvec3 cell = glm::uvec3((points[i] - minCoords) * scale);
+        keys[i] = {morton_3D(cell.x, cell.y, cell.z), uint32_t(i)}; },
+                 4096);
+    std::sort(keys.begin(), keys.end());
+
+    for (size_t i = 0; i < keys.size(); i++)
+        order[i] = keys[i].second;
+    return order;
+}
+
 glm::vec3 utils::get_tangent_gram_smidt(glm::vec3 &p1, glm::vec3 &p2, glm::vec3 &p3, glm::vec2 &uv1, glm::vec2 &uv2, glm::vec2 &uv3, glm::vec3 normal)
 {
     return glm::vec3();
 }
 
-GLIB_NAMESPACE_END
+utils::MappedFile::MappedFile(const std::string &pathToFile)
+{
+#ifdef _WIN32
+    HANDLE file = CreateFileA(pathToFile.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        throw std::runtime_error("could not open file to map " + pathToFile);
+
+    LARGE_INTEGER size;
+    GetFileSizeEx(file, &size);
+    m_size = static_cast<size_t>(size.QuadPart);
+    m_file = file;
+    if (m_size == 0)
+        return;
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping == NULL)
+    {
+        CloseHandle(file);
+        throw std::runtime_error("could not map file " + pathToFile);
+    }
+    m_mapping = mapping;
+    m_data = static_cast<const uint8_t *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+#else
+    int fd = open(pathToFile.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("could not open file to map " + pathToFile);
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        throw std::runtime_error("could not stat file " + pathToFile);
+    }
+    m_size = static_cast<size_t>(st.st_size);
+    if (m_size == 0)
+    {
+        close(fd);
+        return;
+    }
+
+    void *ptr = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping keeps its own reference to the file
+    close(fd);
+    if (ptr == MAP_FAILED)
+        throw std::runtime_error("could not map file " + pathToFile);
+
+    // Loaders walk the file front to back
+    madvise(ptr, m_size, MADV_SEQUENTIAL);
+    m_data = static_cast<const uint8_t *>(ptr);
+#endif
+}
+
+utils::MappedFile::~MappedFile()
+{
+#ifdef _WIN32
+    if (m_data)
+        UnmapViewOfFile(m_data);
+    if (m_mapping)
+        CloseHandle(m_mapping);
+    if (m_file)
+        CloseHandle(m_file);
+#else
+    if (m_data)
+        munmap(const_cast<uint8_t *>(m_data), m_size);
+#endif
+}
+
+GLIB_NAMESPACE_END
\ No newline at end of file
@@ -3,9 +3,13 @@
 
 #include <functional>
 #include <deque>
+#include <mutex>
+#include <atomic>
 #include <fstream>
 #include <chrono>
+#include <cstring>
 #include "core.h"
+#include "thread_pool.h"
 
 GLIB_NAMESPACE_BEGIN
 
@@ -32,6 +36,96 @@ namespace utils
             functions.clear();
         }
     };
+    /*
+    Queue guarded by a mutex. Safe to push from loader threads while the GL thread pops.
+    */
+    template <typename T>
+    class SafeQueue
+    {
+        std::deque<T> m_items;
+        mutable std::mutex m_mutex;
+
+    public:
+        void push(T &&item)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_items.push_back(std::move(item));
+        }
+
+        bool try_pop(T &item)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_items.empty())
+                return false;
+            item = std::move(m_items.front());
+            m_items.pop_front();
+            return true;
+        }
+
+        bool empty() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_items.empty();
+        }
+    };
+    /*
+    Lock free multi producer, single consumer queue. Producers push with a CAS on the list head and the
+    consumer takes the whole list at once, so no thread ever blocks on another.
+    */
+    template <typename T>
+    class LockFreeQueue
+    {
+        struct Node
+        {
+            T value;
+            Node *next;
+        };
+        std::atomic<Node *> m_head{nullptr};
+
+    public:
+        LockFreeQueue() = default;
+        LockFreeQueue(const LockFreeQueue &) = delete;
+        LockFreeQueue &operator=(const LockFreeQueue &) = delete;
+        ~LockFreeQueue()
+        {
+            drain([](T &) {});
+        }
+
+        void push(T &&item)
+        {
+            Node *node = new Node{std::move(item), m_head.load(std::memory_order_relaxed)};
+            while (!m_head.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed))
+                ;
+        }
+
+        /*
+        Consumer thread only. Calls f on every queued item in push order.
+        */
+        template <typename F>
+        void drain(F &&f)
+        {
+            Node *node = m_head.exchange(nullptr, std::memory_order_acquire);
+
+            // List is LIFO, reverse it to keep submission order
+            Node *ordered = nullptr;
+            while (node)
+            {
+                Node *next = node->next;
+                node->next = ordered;
+                ordered = node;
+                node = next;
+            }
+            while (ordered)
+            {
+                Node *next = ordered->next;
+                f(ordered->value);
+                delete ordered;
+                ordered = next;
+            }
+        }
+
+        bool empty() const { return m_head.load(std::memory_order_acquire) == nullptr; }
+    };
     class ManualTimer
     {
         std::chrono::high_resolution_clock::time_point t0;
@@ -93,6 +187,30 @@ namespace utils
             throw std::runtime_error("could not open binary ifstream to path " + pathToFile);
         return fileBufferBytes;
     }
+    /*
+    Read-only memory mapping of a whole file. Pages are faulted in lazily by the OS, so the
+    contents can be parsed in place without staging them in a heap buffer first.
+    */
+    class MappedFile
+    {
+        const uint8_t *m_data{nullptr};
+        size_t m_size{0};
+#ifdef _WIN32
+        void *m_file{nullptr};
+        void *m_mapping{nullptr};
+#endif
+
+    public:
+        MappedFile(const std::string &pathToFile);
+        ~MappedFile();
+
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        inline const uint8_t *data() const { return m_data; }
+        inline size_t size() const { return m_size; }
+    };
+
     glm::vec3 get_tangent_gram_smidt(glm::vec3 &p1, glm::vec3 &p2, glm::vec3 &p3, glm::vec2 &uv1, glm::vec2 &uv2, glm::vec2 &uv3, glm::vec3 normal);
 
     template <typename T, typename... Rest>
@@ -102,6 +220,107 @@ namespace utils
         (hash_combine(seed, rest), ...);
     }
 
+    /*
+    64-bit FNV-1a style hash over a block of memory, consuming 8 bytes per step. Meant for content
+    keys (e.g. cache invalidation) rather than hash tables.
+    */
+    inline uint64_t hash_bytes(const void *data, size_t size, uint64_t seed = 0xcbf29ce484222325ull)
+    {
+        const uint64_t PRIME = 0x100000001b3ull;
+        const uint8_t *bytes = static_cast<const uint8_t *>(data);
+        uint64_t hash = seed;
+
+        size_t i = 0;
+        for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+        {
+            uint64_t word;
+            memcpy(&word, bytes + i, sizeof(uint64_t));
+            hash = (hash ^ word) * PRIME;
+        }
+        for (; i < size; i++)
+            hash = (hash ^ bytes[i]) * PRIME;
+
+        return hash;
+    }
+
+    /*
+    Counter based random numbers: the n-th value of a stream is a hash (SplitMix64 finalizer) of its seed and n.
+    Values can be drawn in any order from any thread, so parallel work is reproducible regardless of scheduling.
+    */
+    inline uint64_t hash_counter(uint64_t seed, uint64_t counter)
+    {
+        uint64_t z = seed + (counter + 1) * 0x9e3779b97f4a7c15ull;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+
+    struct CounterRNG
+    {
+        uint64_t seed{0};
+        uint64_t counter{0};
+
+        CounterRNG(uint64_t streamSeed, uint64_t stream = 0) : seed(hash_counter(streamSeed, stream)) {}
+
+        inline uint32_t next_uint() { return static_cast<uint32_t>(hash_counter(seed, counter++) >> 32); }
+        /*
+        Uniform in [0, 1)
+        */
+        inline float next_float() { return (next_uint() >> 8) * (1.0f / 16777216.0f); }
+        inline glm::vec2 next_vec2() { return {next_float(), next_float()}; }
+    };
+
+    inline uint32_t reverse_bits(uint32_t x)
+    {
+        x = (x << 16) | (x >> 16);
+        x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+        x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+        x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+        return ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+    }
+
+    /*
+    Point index of the first two Sobol dimensions, randomized by XOR scrambling with scramble (one value per set
+    of points keeps each set well distributed while decorrelating them). Uniform in [0, 1)^2.
+    */
+    inline glm::vec2 sobol_2D(uint32_t index, uint32_t scrambleX = 0, uint32_t scrambleY = 0)
+    {
+        // First dimension is the radical inverse in base 2
+        const uint32_t x = reverse_bits(index);
+
+        // Second dimension direction numbers follow v(k+1) = v(k) ^ (v(k) >> 1)
+        uint32_t y = 0;
+        for (uint32_t v = 1u << 31; index; index >>= 1, v ^= v >> 1)
+            if (index & 1)
+                y ^= v;
+
+        return {((x ^ scrambleX) >> 8) * (1.0f / 16777216.0f), ((y ^ scrambleY) >> 8) * (1.0f / 16777216.0f)};
+    }
+
+    /*
+    Interleaves the low 21 bits of x, y and z into a 63-bit Morton code.
+    */
+    inline uint64_t morton_3D(uint32_t x, uint32_t y, uint32_t z)
+    {
+        auto spread = [](uint64_t v)
+        {
+            v &= 0x1fffffull;
+            v = (v | (v << 32)) & 0x1f00000000ffffull;
+            v = (v | (v << 16)) & 0x1f0000ff0000ffull;
+            v = (v | (v << 8)) & 0x100f00f00f00f00full;
+            v = (v | (v << 4)) & 0x10c30c30c30c30c3ull;
+            v = (v | (v << 2)) & 0x1249249249249249ull;
+            return v;
+        };
+        return spread(x) | (spread(y) << 1) | (spread(z) << 2);
+    }
+
+    /*
+    Order that sorts points along a Morton (Z-order) curve over their bounding box, so points next to each other
+    in the order are close in space. Points with the same code keep their relative order.
+    */
+    std::vector<uint32_t> morton_order(const std::vector<glm::vec3> &points);
+
     const std::string HDRIConverterVertexSource = R"(
     #version 460 core
 
@@ -0,0 +1,116 @@
+#include "hair_cache.h"
+
+namespace hair_cache
+{
+    struct Header
+    {
+        char signature[4]; // "HCCH"
+        uint32_t version;
+        uint32_t vectorSize;
+        uint32_t indexSize;
+        uint64_t sourceHash;
+        uint64_t paramsHash;
+        uint64_t vertexCount;
+        uint64_t strandCount;
+        float center[3];
+        float radius;
+    };
+
+    std::string get_path(const char *fileName)
+    {
+        return std::string(fileName) + ".hcache";
+    }
+
+    bool load(const std::string &path, const Key &key, HairGeometry &g, Sphere &bv)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file.is_open())
+            return false;
+
+        Header header;
+        if (!file.read(reinterpret_cast<char *>(&header), sizeof(Header)))
+            return false;
+
+        if (strncmp(header.signature, "HCCH", 4) != 0 ||
+            header.version != VERSION ||
+            header.vectorSize != sizeof(glm::vec3) ||
+            header.indexSize != sizeof(int) ||
+            header.sourceHash != key.source ||
+            header.paramsHash != key.params)
+            return false;
+
+        // Counts are checked against the file size before anything is allocated, so a corrupt entry is a miss
+        // instead of a huge allocation
+        const std::streamoff headerEnd = file.tellg();
+        file.seekg(0, std::ios::end);
+        const uint64_t payload = static_cast<uint64_t>(file.tellg() - headerEnd);
+        file.seekg(headerEnd);
+        const uint64_t vertexBytes = 2 * sizeof(glm::vec3);
+        const uint64_t strandBytes = 2 * sizeof(int) + sizeof(glm::vec3) + sizeof(float);
+        if (header.vertexCount > payload / vertexBytes || header.strandCount > payload / strandBytes ||
+            header.vertexCount * vertexBytes + header.strandCount * strandBytes > payload)
+        {
+            ERR_LOG("Hair cache " << path << " is truncated, rebuilding");
+            return false;
+        }
+
+        // Arrays are stored exactly as they are held in memory, so they are read straight into place
+        g.resize(header.vertexCount, header.strandCount);
+        if (!file.read(reinterpret_cast<char *>(g.positions.data()), header.vertexCount * sizeof(glm::vec3)) ||
+            !file.read(reinterpret_cast<char *>(g.tangents.data()), header.vertexCount * sizeof(glm::vec3)) ||
+            !file.read(reinterpret_cast<char *>(g.strands.first.data()), header.strandCount * sizeof(int)) ||
+            !file.read(reinterpret_cast<char *>(g.strands.count.data()), header.strandCount * sizeof(int)) ||
+            !file.read(reinterpret_cast<char *>(g.colors.data()), header.strandCount * sizeof(glm::vec3)) ||
+            !file.read(reinterpret_cast<char *>(g.thickness.data()), header.strandCount * sizeof(float)))
+        {
+            ERR_LOG("Hair cache " << path << " is truncated, rebuilding");
+            g = HairGeometry{};
+            return false;
+        }
+
+        bv = Sphere({header.center[0], header.center[1], header.center[2]}, header.radius);
+        return true;
+    }
+
+    void save(const std::string &path, const Key &key, const HairGeometry &g, const Sphere &bv)
+    {
+        Header header{};
+        memcpy(header.signature, "HCCH", 4);
+        header.version = VERSION;
+        header.vectorSize = sizeof(glm::vec3);
+        header.indexSize = sizeof(int);
+        header.sourceHash = key.source;
+        header.paramsHash = key.params;
+        header.vertexCount = g.vertex_count();
+        header.strandCount = g.strand_count();
+        header.center[0] = bv.center.x;
+        header.center[1] = bv.center.y;
+        header.center[2] = bv.center.z;
+        header.radius = bv.radius;
+
+        // Write aside and rename, so an interrupted run never leaves a half written entry behind
+        const std::string tmpPath = path + ".tmp";
+        {
+            std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+            if (!file.is_open())
+            {
+                ERR_LOG("Could not write hair cache " << path);
+                return;
+            }
+            file.write(reinterpret_cast<const char *>(&header), sizeof(Header));
+            file.write(reinterpret_cast<const char *>(g.positions.data()), g.vertex_count() * sizeof(glm::vec3));
+            file.write(reinterpret_cast<const char *>(g.tangents.data()), g.vertex_count() * sizeof(glm::vec3));
+            file.write(reinterpret_cast<const char *>(g.strands.first.data()), g.strand_count() * sizeof(int));
+            file.write(reinterpret_cast<const char *>(g.strands.count.data()), g.strand_count() * sizeof(int));
+            file.write(reinterpret_cast<const char *>(g.colors.data()), g.strand_count() * sizeof(glm::vec3));
+            file.write(reinterpret_cast<const char *>(g.thickness.data()), g.strand_count() * sizeof(float));
+            if (!file)
+            {
+                ERR_LOG("Could not write hair cache " << path);
+                return;
+            }
+        }
+        std::remove(path.c_str());
+        std::rename(tmpPath.c_str(), path.c_str());
+    }
+}
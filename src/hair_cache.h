@@ -0,0 +1,42 @@
+#ifndef __HAIR_CACHE__
+#define __HAIR_CACHE__
+
+#include "engine/hair_mesh.h"
+
+USING_NAMESPACE_GLIB
+
+/*
+On-disk cache of fully processed hair geometry (vertex and strand arrays, strand table and bounding sphere).
+Entries are keyed on the source file contents and the processing parameters, so any change in either
+makes the loader rebuild and overwrite the entry.
+
+Entries hold the processed HairGeometry rather than packed GPU buffers. They are read on loader threads, which have no
+GL context, and the mesh needs the CPU arrays anyway (bounding volume, child interpolation, residency). The arrays are
+read straight into place and take the regular upload path, which packs them into StrandVertex, so the format on disk
+does not have to follow the GPU layout.
+*/
+namespace hair_cache
+{
+    // Bump whenever the stored layout or the processing that produced it changes
+    const uint32_t VERSION = 6;
+
+    struct Key
+    {
+        uint64_t source; // Hash of the source file bytes
+        uint64_t params; // Hash of every parameter that alters the processed output
+    };
+
+    /*
+    Path of the cache entry that belongs to a source file.
+    */
+    std::string get_path(const char *fileName);
+
+    /*
+    Fills geometry and bounding sphere if a valid entry for the key exists. Returns false on a miss.
+    */
+    bool load(const std::string &path, const Key &key, HairGeometry &g, Sphere &bv);
+
+    void save(const std::string &path, const Key &key, const HairGeometry &g, const Sphere &bv);
+}
+
+#endif
@@ -1,13 +1,401 @@
 #include "hair_loaders.h"
 
-void hair_loaders::load_neural_hair(Mesh *const mesh, const char *fileName, Mesh *const skullMesh, bool preload, bool verbose, bool calculateTangents)
+namespace
 {
+    bool restore_from_cache(HairMesh *const mesh, const std::string &path, const hair_cache::Key &key)
+    {
+        HairGeometry g;
+        Sphere bv;
+        if (!hair_cache::load(path, key, g, bv))
+            return false;
 
-    std::unique_ptr<std::istream> file_stream;
-    std::vector<uint8_t> byte_buffer;
-    std::string filePath = fileName;
-    try
+        if (mesh->is_streaming())
+        {
+            mesh->push_batch(std::move(g));
+            mesh->push_bounding_volume(new Sphere(bv));
+        }
+        else
+        {
+            mesh->set_geometry(std::move(g));
+            mesh->set_bounding_volume(new Sphere(bv));
+        }
+        return true;
+    }
+
+    /*
+    Balanced k-d tree over a fixed set of points. The tree is implicit: points are permuted so the median
+    of every range is the node splitting it, cycling x, y, z with depth. Queries never allocate.
+    */
+    class KDTree
+    {
+        std::vector<glm::vec3> m_points;
+        std::vector<unsigned int> m_ids; // Caller ids, in tree order
+
+        static void build(const std::vector<glm::vec3> &points, std::vector<unsigned int> &order, size_t begin, size_t end, int axis)
+        {
+            if (end - begin < 2)
+                return;
+
+            const size_t mid = (begin + end) / 2;
+            std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end, [&](unsigned int a, unsigned int b)
+                             { return points[a][axis] < points[b][axis]; });
+
+            build(points, order, begin, mid, (axis + 1) % 3);
+            build(points, order, mid + 1, end, (axis + 1) % 3);
+        }
+
+    public:
+        /*
+        Up to K nearest points, closest first. Distances are squared.
+        */
+        template <size_t K>
+        struct Nearest
+        {
+            unsigned int id[K];
+            float dist2[K];
+            size_t count{0};
+
+            inline float worst() const { return count < K ? std::numeric_limits<float>::max() : dist2[K - 1]; }
+
+            void insert(unsigned int i, float d2)
+            {
+                if (d2 >= worst())
+                    return;
+                size_t n = count < K ? count++ : K - 1;
+                for (; n > 0 && dist2[n - 1] > d2; n--)
+                {
+                    id[n] = id[n - 1];
+                    dist2[n] = dist2[n - 1];
+                }
+                id[n] = i;
+                dist2[n] = d2;
+            }
+        };
+
+        KDTree() = default;
+        KDTree(const std::vector<glm::vec3> &points, const std::vector<unsigned int> &ids)
+        {
+            std::vector<unsigned int> order(points.size());
+            std::iota(order.begin(), order.end(), 0);
+            build(points, order, 0, order.size(), 0);
+
+            m_points.resize(order.size());
+            m_ids.resize(order.size());
+            for (size_t i = 0; i < order.size(); i++)
+            {
+                m_points[i] = points[order[i]];
+                m_ids[i] = ids[order[i]];
+            }
+        }
+
+        inline size_t size() const { return m_points.size(); }
+
+        template <size_t K>
+        void nearest(const glm::vec3 &query, Nearest<K> &result, size_t begin, size_t end, int axis) const
+        {
+            if (begin >= end)
+                return;
+
+            const size_t mid = (begin + end) / 2;
+            const glm::vec3 d = m_points[mid] - query;
+            result.insert(m_ids[mid], glm::dot(d, d));
+
+            // Descend the side holding the query first, the other one only if the splitting plane is closer than the worst match
+            const float planeDist = query[axis] - m_points[mid][axis];
+            const int next = (axis + 1) % 3;
+            if (planeDist < 0.0f)
+            {
+                nearest(query, result, begin, mid, next);
+                if (planeDist * planeDist < result.worst())
+                    nearest(query, result, mid + 1, end, next);
+            }
+            else
+            {
+                nearest(query, result, mid + 1, end, next);
+                if (planeDist * planeDist < result.worst())
+                    nearest(query, result, begin, mid, next);
+            }
+        }
+
+        template <size_t K>
+        Nearest<K> nearest(const glm::vec3 &query) const
+        {
+            Nearest<K> result;
+            nearest(query, result, 0, m_points.size(), 0);
+            return result;
+        }
+    };
+
+    /*
+    Area weighted sampler over the scalp triangles of a skull, those with a vertex whose blue is below
+    SCALP_THRESHOLD. Triangles are picked in constant time from an alias table (Vose), so any number of
+    roots can be drawn independently and in parallel.
+    */
+    class ScalpSampler
+    {
+    public:
+        struct Triangle
+        {
+            glm::vec3 a, b, c;
+        };
+
+        static constexpr float SCALP_THRESHOLD = 0.1f;
+
+    private:
+        std::vector<Triangle> m_triangles;
+        std::vector<float> m_keep;     // Chance of a column picking its own triangle rather than its alias
+        std::vector<uint32_t> m_alias; // Triangle picked otherwise
+
+    public:
+        explicit ScalpSampler(const Geometry &skull)
+        {
+            const std::vector<Vertex> &vertices = skull.vertices;
+            const std::vector<unsigned int> &indices = skull.indices;
+            std::vector<double> areas;
+            double totalArea = 0.0;
+            for (size_t i = 0; i + 2 < indices.size(); i += 3)
+            {
+                const Vertex &a = vertices[indices[i]], &b = vertices[indices[i + 1]], &c = vertices[indices[i + 2]];
+                if (a.color.b >= SCALP_THRESHOLD && b.color.b >= SCALP_THRESHOLD && c.color.b >= SCALP_THRESHOLD)
+                    continue;
+                m_triangles.push_back({a.position, b.position, c.position});
+                areas.push_back(0.5 * glm::length(glm::cross(b.position - a.position, c.position - a.position)));
+                totalArea += areas.back();
+            }
+
+            // Columns scaled to an average of 1. Poor ones are topped up by rich ones until all are full
+            const size_t N = m_triangles.size();
+            m_keep.assign(N, 1.0f);
+            m_alias.resize(N);
+            std::vector<uint32_t> poor, rich;
+            for (uint32_t t = 0; t < N; t++)
+            {
+                m_alias[t] = t;
+                areas[t] = totalArea > 0.0 ? areas[t] * N / totalArea : 1.0;
+                (areas[t] < 1.0 ? poor : rich).push_back(t);
+            }
+            while (!poor.empty() && !rich.empty())
+            {
+                const uint32_t p = poor.back(), r = rich.back();
+                poor.pop_back();
+                m_keep[p] = static_cast<float>(areas[p]);
+                m_alias[p] = r;
+                areas[r] -= 1.0 - areas[p];
+                if (areas[r] < 1.0)
+                {
+                    rich.pop_back();
+                    poor.push_back(r);
+                }
+            }
+        }
+
+        inline size_t size() const { return m_triangles.size(); }
+
+        inline const Triangle &get_triangle(size_t t) const { return m_triangles[t]; }
+
+        /*
+        Picks a triangle with a chance proportional to its area. Only the first coordinate of sample is
+        used, then replaced by a fresh uniform value, so sample can place the point within the triangle.
+        */
+        size_t pick(glm::vec2 &sample) const
+        {
+            const double column = double(sample.x) * m_triangles.size();
+            const size_t t = std::min(static_cast<size_t>(column), m_triangles.size() - 1);
+            const double u = column - t;
+            if (u < m_keep[t])
+            {
+                sample.x = static_cast<float>(u / m_keep[t]);
+                return t;
+            }
+            sample.x = static_cast<float>((u - m_keep[t]) / (1.0 - m_keep[t]));
+            return m_alias[t];
+        }
+    };
+
+    /*
+    Scalp sampler of a skull mesh, built on first use and kept as long as the skull geometry hashes the same.
+    */
+    std::shared_ptr<const ScalpSampler> get_scalp_sampler(const Mesh *const skullMesh, uint64_t skullHash)
+    {
+        struct Entry
+        {
+            uint64_t hash;
+            std::shared_ptr<const ScalpSampler> sampler;
+        };
+        static std::mutex mutex;
+        static std::unordered_map<const Mesh *, Entry> samplers;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        Entry &entry = samplers[skullMesh];
+        if (!entry.sampler || entry.hash != skullHash)
+            entry = {skullHash, std::make_shared<const ScalpSampler>(skullMesh->get_geometry())};
+        return entry.sampler;
+    }
+
+    /*
+    Copies strands [strandStart, strandEnd) of g into a self contained batch, decimated as the whole geometry will be.
+    */
+    HairGeometry make_batch(const HairGeometry &g, size_t strandStart, size_t strandEnd, float tolerance)
+    {
+        HairGeometry batch = g.extract(strandStart, strandEnd);
+        hair_loaders::decimate_strands(batch, tolerance);
+        return batch;
+    }
+
+    /*
+    Queues strands [strandStart, strandEnd) of g as a batch on a streaming mesh.
+    */
+    void publish_batch(HairMesh *const mesh, const HairGeometry &g, size_t strandStart, size_t strandEnd, float tolerance)
     {
+        if (strandStart >= strandEnd)
+            return;
+        mesh->push_batch(make_batch(g, strandStart, strandEnd, tolerance));
+    }
+
+    /*
+    Thread safe. Queues batches built in parallel on a streaming mesh in index order, whatever order they are done
+    in. Batch b is held back until batches 0 to b - 1 are queued, so the strands reach the GPU in storage order.
+    */
+    class OrderedBatchPublisher
+    {
+        HairMesh *const m_mesh;
+        std::mutex m_mutex;
+        std::vector<HairGeometry> m_batches;
+        std::vector<uint8_t> m_done;
+        size_t m_next{0};
+
+    public:
+        OrderedBatchPublisher(HairMesh *const mesh, size_t batches) : m_mesh(mesh), m_batches(batches), m_done(batches, 0) {}
+
+        void publish(size_t index, HairGeometry &&batch)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_batches[index] = std::move(batch);
+            m_done[index] = 1;
+            for (; m_next < m_done.size() && m_done[m_next]; m_next++)
+                if (m_batches[m_next].strand_count() > 0)
+                    m_mesh->push_batch(std::move(m_batches[m_next]));
+        }
+    };
+
+    /*
+    Hands the final geometry to the mesh. Streaming meshes already received it batch by batch,
+    so they only get the bounding volume, through the thread safe path.
+    */
+    void publish_geometry(HairMesh *const mesh, HairGeometry &g, bool useCache, const std::string &cachePath, const hair_cache::Key &cacheKey)
+    {
+        Sphere *bv = new Sphere(g.compute_bounding_sphere());
+        if (useCache)
+            hair_cache::save(cachePath, cacheKey, g, *bv);
+
+        if (mesh->is_streaming())
+            mesh->push_bounding_volume(bv);
+        else
+        {
+            mesh->set_geometry(std::move(g));
+            mesh->set_bounding_volume(bv);
+        }
+    }
+
+    /*
+    Appends a run of strand vertices to g, the run may continue the last strand of g. Consecutive vertices of a
+    strand share the same RGB color, a change of color starts a new strand. Tangents are left to
+    compute_strand_tangents() once every run is in.
+    */
+    void append_strand_vertices(const std::vector<Vertex> &vertices, HairGeometry &g)
+    {
+        const size_t NUM_VERTICES = vertices.size();
+        const size_t FIRST_VERTEX = g.positions.size();
+        const size_t FIRST_STRAND = g.strand_count();
+        if (NUM_VERTICES == 0)
+            return;
+        const glm::vec3 LAST_COLOR = FIRST_STRAND > 0 ? g.colors.back() : glm::vec3(0.0f);
+
+        auto isRoot = [&](size_t i)
+        {
+            if (i == 0)
+                return FIRST_STRAND == 0 || vertices[0].color != LAST_COLOR;
+            return vertices[i].color != vertices[i - 1].color;
+        };
+
+        // Segmented scan: every chunk of vertices counts its roots, an exclusive sum over the chunk
+        // counts then tells each chunk where its roots go in the strand table
+        const size_t NUM_CHUNKS = 4 * utils::ThreadPool::global().size();
+        const size_t VERTICES_PER_CHUNK = (NUM_VERTICES + NUM_CHUNKS - 1) / NUM_CHUNKS;
+        std::vector<size_t> chunkRoots(NUM_CHUNKS + 1, 0);
+
+        utils::parallel_for(0, NUM_CHUNKS, [&](size_t chunk)
+                            {
+            const size_t START = std::min(VERTICES_PER_CHUNK * chunk, NUM_VERTICES);
+            const size_t END = std::min(VERTICES_PER_CHUNK * (chunk + 1), NUM_VERTICES);
+            for (size_t i = START; i < END; i++)
+                if (isRoot(i))
+                    chunkRoots[chunk + 1]++; },
+                            1);
+
+        for (size_t c = 0; c < NUM_CHUNKS; c++)
+            chunkRoots[c + 1] += chunkRoots[c];
+        const size_t NUM_STRANDS = FIRST_STRAND + chunkRoots[NUM_CHUNKS];
+
+        g.positions.resize(FIRST_VERTEX + NUM_VERTICES);
+        g.strands.resize(NUM_STRANDS);
+        g.colors.resize(NUM_STRANDS);
+        g.thickness.resize(NUM_STRANDS, 1.0f);
+
+        utils::parallel_for(0, NUM_CHUNKS, [&](size_t chunk)
+                            {
+            const size_t START = std::min(VERTICES_PER_CHUNK * chunk, NUM_VERTICES);
+            const size_t END = std::min(VERTICES_PER_CHUNK * (chunk + 1), NUM_VERTICES);
+            size_t strand = FIRST_STRAND + chunkRoots[chunk];
+            for (size_t i = START; i < END; i++)
+            {
+                g.positions[FIRST_VERTEX + i] = vertices[i].position;
+                if (isRoot(i))
+                {
+                    g.strands.first[strand] = FIRST_VERTEX + i;
+                    g.colors[strand++] = vertices[i].color;
+                }
+            } },
+                            1);
+
+        // The last strand so far may grow with the run
+        for (size_t s = FIRST_STRAND > 0 ? FIRST_STRAND - 1 : 0; s < NUM_STRANDS; s++)
+            g.strands.count[s] = (s + 1 < NUM_STRANDS ? g.strands.first[s + 1] : g.positions.size()) - g.strands.first[s];
+    }
+
+    /*
+    Strand tangents point to the next vertex, the tip keeps the direction of its last segment.
+    */
+    void compute_strand_tangents(HairGeometry &g)
+    {
+        g.tangents.resize(g.vertex_count());
+        utils::parallel_for_range(0, g.strand_count(), [&](size_t START, size_t END)
+                                  {
+            for (size_t s = START; s < END; s++)
+            {
+                const size_t first = g.strands.first[s];
+                const size_t last = first + g.strands.count[s];
+                for (size_t i = first; i + 1 < last; i++)
+                {
+                    // Repeated points keep the direction before them
+                    const glm::vec3 segment = g.positions[i + 1] - g.positions[i];
+                    if (glm::dot(segment, segment) > 0.0f)
+                        g.tangents[i] = glm::normalize(segment);
+                    else
+                        g.tangents[i] = i > first ? g.tangents[i - 1] : glm::vec3(0.0f, 1.0f, 0.0f);
+                }
+                g.tangents[last - 1] = last - first > 1 ? g.tangents[last - 2] : glm::vec3(0.0f, 1.0f, 0.0f);
+            } });
+    }
+
+    /*
+    Reads strand vertices (positions and colors) through tinyply, for PLY layouts the fast path does not handle.
+    */
+    void read_strand_vertices(const std::string &filePath, bool preload, bool verbose, Geometry &g)
+    {
+        std::unique_ptr<std::istream> file_stream;
+        std::vector<uint8_t> byte_buffer;
+
         if (preload)
         {
             byte_buffer = utils::read_file_binary(filePath);
@@ -82,53 +470,172 @@ void hair_loaders::load_neural_hair(Mesh *const mesh, const char *fileName, Mesh
                 std::cout << "\tRead " << colors->count << " total vertex colors " << std::endl;
         }
 
-        std::vector<Vertex> vertices;
-        vertices.reserve(positions->count);
-        std::vector<unsigned int> indices;
-        std::vector<unsigned int> rootsIndices;
+        if (!positions || !colors)
+            throw std::runtime_error("strands need vertex positions and colors in " + filePath);
 
-        if (positions)
+        const float *posData = reinterpret_cast<const float *>(positions->buffer.get());
+        const unsigned char *colorData = reinterpret_cast<const unsigned char *>(colors->buffer.get());
+        g.vertices.resize(positions->count);
+        utils::parallel_for(0, positions->count, [&](size_t i)
+                            {
+            const glm::vec3 pos = {posData[i * 3], posData[i * 3 + 1], posData[i * 3 + 2]};
+            const glm::vec3 color = {colorData[i * 4] / 255.0f, colorData[i * 4 + 1] / 255.0f, colorData[i * 4 + 2] / 255.0f};
+            g.vertices[i] = {pos, {0.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f}, color}; });
+    }
+}
+
+void hair_loaders::decimate_strands(HairGeometry &g, float tolerance)
+{
+    if (tolerance <= 0.0f || g.strands.empty())
+        return;
+
+    // Points kept by every strand
+    const float TOLERANCE2 = tolerance * tolerance;
+    std::vector<uint8_t> keep(g.vertex_count(), 0);
+    std::vector<int> kept(g.strand_count());
+    utils::parallel_for_range(0, g.strand_count(), [&](size_t START, size_t END)
+                              {
+        std::vector<std::pair<size_t, size_t>> spans;
+        for (size_t s = START; s < END; s++)
         {
-            rootsIndices.push_back(0); // First index is certainly a root
-            const float *posData = reinterpret_cast<const float *>(positions->buffer.get());
-            const unsigned char *colorData = reinterpret_cast<const unsigned char *>(colors->buffer.get());
-            for (size_t i = 0; i < positions->count - 1; i++)
+            const size_t first = g.strands.first[s];
+            const size_t last = first + g.strands.count[s] - 1;
+            keep[first] = keep[last] = 1;
+
+            // Spans are split at their farthest point until every point is within tolerance of its span
+            spans.push_back({first, last});
+            while (!spans.empty())
             {
-                float x = posData[i * 3];
-                float y = posData[i * 3 + 1];
-                float z = posData[i * 3 + 2];
-
-                // Generate hair tangents
-                glm::vec3 pos = {x, y, z};
-                float nextX = posData[(i + 1) * 3];
-                float nextY = posData[(i + 1) * 3 + 1];
-                float nextZ = posData[(i + 1) * 3 + 2];
-                glm::vec3 nextPos = {nextX, nextY, nextZ};
-                glm::vec3 tangent = glm::normalize(nextPos - pos);
-
-                float r = (float)colorData[i * 4];
-                float g = (float)colorData[i * 4 + 1];
-                float b = (float)colorData[i * 4 + 2];
-
-                float nextR = (float)colorData[(i + 1) * 4];
-                float nextG = (float)colorData[(i + 1) * 4 + 1];
-                float nextB = (float)colorData[(i + 1) * 4 + 2];
-
-                vertices.push_back({pos, {0.0f, 0.0f, 0.0f}, tangent, {0.0f, 0.0f}, {r / 255, g / 255, b / 255}});
-                if (i == positions->count - 2)
-                    vertices.push_back({nextPos, {0.0f, 0.0f, 0.0f}, tangent, {0.0f, 0.0f}, {r / 255, g / 255, b / 255}});
-
-                if (r == nextR && g == nextG && b == nextB)
+                const auto [a, b] = spans.back();
+                spans.pop_back();
+                const glm::vec3 ab = g.positions[b] - g.positions[a];
+                const float length2 = glm::dot(ab, ab);
+                float farthest2 = TOLERANCE2;
+                size_t split = a;
+                for (size_t i = a + 1; i < b; i++)
                 {
-                    indices.push_back(i);
-                    indices.push_back(i + 1);
+                    const glm::vec3 ap = g.positions[i] - g.positions[a];
+                    const float t = length2 > 0.0f ? glm::clamp(glm::dot(ap, ab) / length2, 0.0f, 1.0f) : 0.0f;
+                    const glm::vec3 d = ap - t * ab;
+                    if (glm::dot(d, d) > farthest2)
+                    {
+                        farthest2 = glm::dot(d, d);
+                        split = i;
+                    }
                 }
-                else
+                if (split == a)
+                    continue;
+                keep[split] = 1;
+                spans.push_back({a, split});
+                spans.push_back({split, b});
+            }
+            kept[s] = static_cast<int>(std::count(keep.begin() + first, keep.begin() + last + 1, uint8_t(1)));
+        } },
+                              64);
+
+    HairGeometry decimated;
+    decimated.strands.resize(g.strand_count());
+    int vertices = 0;
+    for (size_t s = 0; s < g.strand_count(); s++)
+    {
+        decimated.strands.first[s] = vertices;
+        decimated.strands.count[s] = kept[s];
+        vertices += kept[s];
+    }
+    decimated.positions.resize(vertices);
+    utils::parallel_for(0, g.strand_count(), [&](size_t s)
+                        {
+        size_t to = decimated.strands.first[s];
+        for (size_t i = g.strands.first[s]; i < size_t(g.strands.first[s] + g.strands.count[s]); i++)
+            if (keep[i])
+                decimated.positions[to++] = g.positions[i]; },
+                        256);
+    decimated.colors = std::move(g.colors);
+    decimated.thickness = std::move(g.thickness);
+    compute_strand_tangents(decimated);
+    g = std::move(decimated);
+}
+
+bool hair_loaders::load_neural_hair(HairMesh *const mesh, const char *fileName, const Mesh *const skullMesh, const NeuralHairOptions &options)
+{
+
+    std::string filePath = fileName;
+    try
+    {
+        // Synthesized strands grown over the scalp
+        const unsigned int AUGMENTED_STRANDS = 40000;
+        // Only baked strands are cached
+        const bool useCache = options.useCache && !options.children;
+        // Interpolated children need whole guides
+        const float decimationTolerance = options.children ? 0.0f : options.decimationTolerance;
+
+        // The output depends on the groom file, the skull it is grown on and the augmentation settings. Hashing
+        // the groom is a whole pass over the file, only paid when the cache is used
+        hair_cache::Key cacheKey{};
+        if (useCache)
+        {
+            utils::MappedFile source(filePath);
+            cacheKey.source = utils::hash_bytes(source.data(), source.size());
+        }
+
+        if (!skullMesh->is_geometry_resident())
+            throw std::runtime_error("the skull mesh has to keep its geometry in memory to grow hair from it");
+        // Also tells whether the scalp sampler cached for the skull is still valid
+        uint64_t skullHash;
+        {
+            const Geometry &skull = skullMesh->get_geometry();
+            skullHash = utils::hash_bytes(skull.vertices.data(), skull.vertices.size() * sizeof(Vertex));
+            skullHash = utils::hash_bytes(skull.indices.data(), skull.indices.size() * sizeof(unsigned int), skullHash);
+            uint64_t params = utils::hash_bytes(&AUGMENTED_STRANDS, sizeof(AUGMENTED_STRANDS), skullHash);
+            params = utils::hash_bytes(&options.seed, sizeof(options.seed), params);
+            params = utils::hash_bytes(&options.sampling, sizeof(options.sampling), params);
+            params = utils::hash_bytes(&decimationTolerance, sizeof(decimationTolerance), params);
+            cacheKey.params = params;
+        }
+        const std::string cachePath = hair_cache::get_path(fileName);
+        if (useCache && restore_from_cache(mesh, cachePath, cacheKey))
+        {
+            if (options.verbose)
+                std::cout << "\tLoaded processed hair from cache " << cachePath << std::endl;
+            return true;
+        }
+
+        // The usual layouts, binary or ASCII, are streamed chunk by chunk straight into the strand arrays, so only
+        // the strands and a chunk are held at once
+        HairGeometry g;
+        const Vertex STRAND_VERTEX = {{0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f}, {0.0f, 0.0f, 0.0f}};
+        {
+            loaders::PLYStreamReader reader(fileName, options.readChunkBytes);
+            if (reader.is_supported())
+            {
+                if (!reader.get_info().colors)
+                    throw std::runtime_error("strands need vertex positions and colors in " + filePath);
+
+                g.positions.reserve(reader.get_vertex_count());
+                std::vector<Vertex> chunk;
+                while (reader.read_vertices(chunk, STRAND_VERTEX) > 0)
                 {
-                    rootsIndices.push_back(i + 1);
+                    append_strand_vertices(chunk, g);
+                    chunk.clear();
                 }
+                if (!reader.is_supported())
+                    throw std::runtime_error("malformed or truncated vertex data in " + filePath);
+                if (options.verbose)
+                    std::cout << "\tRead " << g.vertex_count() << " total vertices (fast path)" << std::endl;
+            }
+            else
+            {
+                Geometry raw;
+                read_strand_vertices(filePath, options.preload, options.verbose, raw);
+                append_strand_vertices(raw.vertices, g);
             }
         }
+        compute_strand_tangents(g);
+        // File order is arbitrary, spatially sorted strands draw and cull better. Grown strands are sorted as well
+        g.sort_strands_by_root();
+
+        if (options.verbose)
+            std::cout << "\tFound " << g.strand_count() << " strands" << std::endl;
 
         auto samplePoint = [=](glm::vec2 sample, glm::vec3 a, glm::vec3 b, glm::vec3 c)
         {
@@ -146,50 +653,25 @@ void hair_loaders::load_neural_hair(Mesh *const mesh, const char *fileName, Mesh
             return point;
         };
 
-        auto augmentDensity = [&](Geometry &geom, unsigned int totalStrands)
+        auto augmentDensity = [&](HairGeometry &geom, unsigned int totalStrands)
         {
-
-#define CONCURRENT
-            // Neural haircut asures it
-            const unsigned int STRAND_LENGTH = rootsIndices[1] - rootsIndices[0] - 1;
+            const size_t GUIDES = geom.strands.size();
             // Neighburs (should be user defined)
-            const unsigned int NEIGHBORS = 3;
-            // Color compare threshold for scalp vertices
-            const float COLOR_THRESHOLD = 0.1f;
-
-            // Create a random number generator engine
-            std::random_device rd;
-            std::mt19937 gen(rd());                               // Mersenne Twister PRNG
-            std::uniform_real_distribution<double> dis(0.0, 1.0); // CHANGE IT TO PSEUDORANDOM (BLUE NOISE OR SOBOL)
-
-            std::vector<Vertex> vertices = skullMesh->get_geometry().vertices;
-            std::vector<unsigned int> rawIndices = skullMesh->get_geometry().indices;
-            std::vector<unsigned int> indices;
-
-            // Check triangles susceptible of being scalp in skull
-            for (size_t i = 0; i < rawIndices.size(); i += 3)
-            {
-                if (vertices[rawIndices[i]].color.b < COLOR_THRESHOLD || vertices[rawIndices[i + 1]].color.b < COLOR_THRESHOLD || vertices[rawIndices[i + 2]].color.b < COLOR_THRESHOLD)
-                {
-                    // Save tri indices
-                    indices.push_back(rawIndices[i]);
-                    indices.push_back(rawIndices[i + 1]);
-                    indices.push_back(rawIndices[i + 2]);
-                }
-            }
-            // std::cout<< "SIZE " << indices.size()<< std::endl;
-
-            std::vector<float> areas;
-            float totalArea{0.0f};
-            areas.reserve(indices.size() / 3);
-
-            // Compute total area
-            for (size_t i = 0; i < indices.size(); i += 3)
-            {
-                float area = 0.5f * glm::length(glm::cross(glm::vec3(vertices[indices[i + 1]].position - vertices[indices[i]].position), glm::vec3(vertices[indices[i + 2]].position - vertices[indices[i]].position)));
-                areas.push_back(area);
-                totalArea += area;
-            }
+            constexpr unsigned int NEIGHBORS = 3;
+            if (GUIDES < NEIGHBORS)
+                throw std::runtime_error("density augmentation needs at least " + std::to_string(NEIGHBORS) + " guide strands");
+            // Neural haircut asures it, growth blends guides point by point so anything else is rejected
+            if (geom.strands.count[0] < 2)
+                throw std::runtime_error("density augmentation needs guide strands of at least two points");
+            const unsigned int STRAND_LENGTH = geom.strands.count[0] - 1;
+            for (size_t r = 1; r < GUIDES; r++)
+                if (geom.strands.count[r] != STRAND_LENGTH + 1)
+                    throw std::runtime_error("density augmentation needs guide strands of equal length");
+            // Floor of the root distances neighbor weights are computed from
+            constexpr float MIN_NEIGHBOR_DISTANCE = 1e-6f;
+
+            // Randomness is drawn from counter based streams keyed on the seed. Strand s owns streams 2s (root
+            // placement) and 2s + 1 (growth), so results do not depend on threads or scheduling
 
             struct Neighbor
             {
@@ -198,293 +680,233 @@ void hair_loaders::load_neural_hair(Mesh *const mesh, const char *fileName, Mesh
                 float weight;
             };
 
-#ifdef CONCURRENT
-
-            // NUMBER OF OPERATIONS PER TASK
-            const unsigned int NUM_TRIS = indices.size() / 3;
-            const unsigned int OPERATIONS = 2000;
-            const size_t NUM_TASKS = (NUM_TRIS / OPERATIONS) + 1;
-
-            std::vector<std::thread> tasks;
-            tasks.reserve(NUM_TASKS);
-
-            struct ScalpFace
-            {
-                unsigned int a;
-                unsigned int b;
-                unsigned int c;
-                unsigned int strands;
-                unsigned int cumulative;
-            };
-
-            std::vector<ScalpFace> triangles;
-            triangles.reserve(NUM_TRIS);
-
-            size_t t = 0;
-            unsigned int accumStrands = 0;
-            // Compute triangle areas and strands to grow
-            for (size_t i = 0; i < indices.size(); i += 3, t++)
-            {
-                // Uniformize number
-                float pdf = areas[t] / totalArea;
-                const unsigned int strands = totalStrands * pdf;
-                triangles.push_back({indices[i], indices[i + 1], indices[i + 2], strands, accumStrands});
-                accumStrands += strands;
-            }
+            // Exactly totalStrands roots, spread over the scalp triangles by area
+            const size_t accumStrands = totalStrands;
+            std::shared_ptr<const ScalpSampler> scalp;
+            KDTree guideTree;
+
+            // Scalp setup and guide indexing are independent, they run side by side
+            utils::TaskGraph setup;
+            setup.add([&]
+                      { scalp = get_scalp_sampler(skullMesh, skullHash); });
+            setup.add([&]
+                      {
+                // Guide roots are indexed once, each grown strand then only visits the few tree nodes around it
+                std::vector<glm::vec3> guideRoots(GUIDES);
+                std::vector<unsigned int> guideIds(GUIDES);
+                for (size_t r = 0; r < GUIDES; r++)
+                {
+                    guideIds[r] = geom.strands.first[r];
+                    guideRoots[r] = geom.positions[guideIds[r]];
+                }
+                guideTree = KDTree(guideRoots, guideIds); });
+            setup.run();
 
             // Setup key data strcutures
-            std::vector<std::vector<Neighbor>> nearestNeighbors;
+            std::vector<std::array<Neighbor, NEIGHBORS>> nearestNeighbors;
             nearestNeighbors.resize(accumStrands);
             std::vector<glm::vec3> roots;
             roots.resize(accumStrands);
 
-            auto computeNearestNeighbors = [&](size_t taskID)
-            {
-                for (size_t t = OPERATIONS * taskID; t < OPERATIONS * (taskID + 1); t++)
-                {
-                    if (t >= NUM_TRIS)
-                        break;
-
-                    // FOR STRAND
-                    const size_t START_STRAND = triangles[t].cumulative;
-                    const size_t END_STRAND = triangles[t].cumulative + triangles[t].strands;
-                    for (size_t s = START_STRAND; s < END_STRAND; s++)
-                    {
-                        // Get random value
-                        glm::vec2 sample2D = glm::vec2(dis(gen), dis(gen));
-                        roots[s] = samplePoint(sample2D, vertices[triangles[t].a].position, vertices[triangles[t].b].position, vertices[triangles[t].c].position);
-
-                        // Neighbor adjacency list;
-                        std::vector<Neighbor> potentialNeighbors;
-                        potentialNeighbors.reserve(rootsIndices.size());
-
-                        for (size_t r = 0; r < rootsIndices.size(); r++)
-                        {
-                            float dist = glm::distance(geom.vertices[rootsIndices[r]].position, roots[s]);
-                            Neighbor potentialN{rootsIndices[r], dist};
-                            potentialNeighbors.push_back(potentialN);
-                        }
-
-                        // Sort from closest to farthest
-                        std::sort(potentialNeighbors.begin(), potentialNeighbors.end(), [](const Neighbor &a, const Neighbor &b)
-                                  { return a.dist < b.dist; });
-
-                        int count = 0;
-                        for (auto it = potentialNeighbors.begin(); it != potentialNeighbors.end() && count < NEIGHBORS; ++it, ++count)
-                        {
-                            nearestNeighbors[s].push_back(*it);
-                        }
-
-                        // Compute Neighbor weights
-                        float totalWeight = 0;
-                        for (size_t nn = 0; nn < NEIGHBORS; nn++)
-                        {
-                            nearestNeighbors[s][nn].weight = 1 / (nearestNeighbors[s][nn].dist * nearestNeighbors[s][nn].dist);
-                            totalWeight += nearestNeighbors[s][nn].weight;
-                        }
-                        // // NORMALIZE WEIGHTS
-                        for (size_t nn = 0; nn < NEIGHBORS; nn++)
-                        {
-                            nearestNeighbors[s][nn].weight = nearestNeighbors[s][nn].weight / totalWeight;
-                        }
-                    }
-                }
-            };
+            if (scalp->size() == 0)
+                throw std::runtime_error("the skull mesh has no scalp triangles to grow hair from");
 
-            for (size_t tk = 0; tk < NUM_TASKS; tk++)
-            {
-                std::thread task(computeNearestNeighbors, tk);
-                // task.detach();
-                tasks.push_back(move(task));
-            }
-
-            // WAIT FOR THREADS TO FINISH
-            for (std::thread &t : tasks)
+            // The Sobol set is scrambled from the stream after the strand ones
+            const uint64_t scramble = utils::hash_counter(options.seed, 2 * accumStrands);
+            utils::parallel_for_range(0, accumStrands, [&](size_t START, size_t END)
+                                      {
+                for (size_t s = START; s < END; s++)
+                {
+                    // Get random value, its first coordinate picks the triangle
+                    glm::vec2 sample2D = options.sampling == RootSampling::SOBOL
+                                             ? utils::sobol_2D(uint32_t(s), uint32_t(scramble), uint32_t(scramble >> 32))
+                                             : utils::CounterRNG(options.seed, 2 * s).next_vec2();
+                    const ScalpSampler::Triangle &triangle = scalp->get_triangle(scalp->pick(sample2D));
+                    roots[s] = samplePoint(sample2D, triangle.a, triangle.b, triangle.c);
+                } },
+                                      256);
+
+            // Roots land all over the scalp, they are grown in Morton order so neighboring strands are drawn together
             {
-                t.join();
+                const std::vector<uint32_t> order = utils::morton_order(roots);
+                std::vector<glm::vec3> sortedRoots(accumStrands);
+                for (size_t s = 0; s < accumStrands; s++)
+                    sortedRoots[s] = roots[order[s]];
+                roots = std::move(sortedRoots);
             }
 
-            // NEW STRAND
-
-            for (size_t s = 0; s < accumStrands; s++)
-            {
-                // CHOOSE RANDOM COLOR FOR DEBUG
-                glm::vec3 color = {((float)rand()) / RAND_MAX, ((float)rand()) / RAND_MAX, ((float)rand()) / RAND_MAX};
-
-                unsigned int currentIndex = geom.indices.back() + 1;
-
-                // Add root
-                geom.vertices.push_back({roots[s], {0.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f}, color});
-                geom.indices.push_back(currentIndex);
-                geom.indices.push_back(currentIndex + 1);
-                currentIndex++;
-
-                // Grow
-                for (size_t p = 1; p < STRAND_LENGTH; p++)
+            utils::parallel_for_range(0, accumStrands, [&](size_t START, size_t END)
+                                      {
+                for (size_t s = START; s < END; s++)
                 {
-                    // Compute differentials
-                    glm::vec3 avrDiff = glm::vec3(0.0f);
-                    std::vector<glm::vec3> diffs;
-                    diffs.reserve(3);
+                    // Closest guides first
+                    const KDTree::Nearest<NEIGHBORS> nearest = guideTree.nearest<NEIGHBORS>(roots[s]);
+                    for (size_t nn = 0; nn < NEIGHBORS; nn++)
+                        nearestNeighbors[s][nn] = {nearest.id[nn], std::sqrt(nearest.dist2[nn]), 0.0f};
 
-                    for (size_t n = 0; n < NEIGHBORS; n++)
+                    // Compute Neighbor weights. A root grown right on a guide root would divide by zero
+                    float totalWeight = 0;
+                    for (size_t nn = 0; nn < NEIGHBORS; nn++)
                     {
-                        if (nearestNeighbors[s][n].weight == 0)
-                            continue;
-                        glm::vec3 diff = geom.vertices[nearestNeighbors[s][n].id + p].position - geom.vertices[nearestNeighbors[s][n].id + (p - 1)].position;
-                        diffs.push_back(diff);
-                        avrDiff += diff * nearestNeighbors[s][n].weight;
+                        const float dist = std::max(nearestNeighbors[s][nn].dist, MIN_NEIGHBOR_DISTANCE);
+                        nearestNeighbors[s][nn].weight = 1 / (dist * dist);
+                        totalWeight += nearestNeighbors[s][nn].weight;
                     }
-
-                    // Update predecessor FRAME
-                    geom.vertices[geom.vertices.size() - 1].tangent = glm::normalize(avrDiff);
-                    // Setup new FRAME
-                    geom.vertices.push_back({geom.vertices.back().position + avrDiff, {0.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f}, color});
-
-                    // Control index generation
-                    if (p < STRAND_LENGTH - 1)
+                    // // NORMALIZE WEIGHTS
+                    for (size_t nn = 0; nn < NEIGHBORS; nn++)
                     {
-                        geom.indices.push_back(currentIndex);
-                        geom.indices.push_back(currentIndex + 1);
-                        currentIndex++;
+                        nearestNeighbors[s][nn].weight = nearestNeighbors[s][nn].weight / totalWeight;
                     }
+                } },
+                                      256);
 
-                    // Compare diffs
-                    unsigned int checkID = (rand() % NEIGHBORS);
-                    glm::vec3 cDiff = glm::normalize(diffs[checkID]);
-                    for (size_t n = 0; n < NEIGHBORS; n++)
-                    {
-                        if (n == checkID)
-                            continue;
-                        if (nearestNeighbors[s][n].weight == 0.0f)
-                            continue;
-                        glm::vec3 diff = glm::normalize(diffs[n]);
-                        if (glm::dot(cDiff, diff) <= 0.0f)
-                            nearestNeighbors[s][n].weight = 0.0f;
-                    }
-                }
-            }
-#else
-            // Populate
-            size_t t = 0;
-            // std::cout << indices.size() << std::endl;
+            // NEW STRAND
 
-            for (size_t i = 0; i < indices.size(); i += 3, t++)
+            // Children interpolated at render time only keep their interpolation record, the guides stay the only geometry
+            const bool BAKE = options.children == nullptr;
+            if (!BAKE && STRAND_LENGTH > ChildStrand::MAX_LENGTH)
+                throw std::runtime_error("render time interpolation supports strands of up to " + std::to_string(ChildStrand::MAX_LENGTH) + " vertices");
+
+            // Every grown strand has STRAND_LENGTH vertices, so where each one lands is known upfront and
+            // strands are grown in parallel straight into their slots
+            const size_t FIRST_NEW_STRAND = geom.strands.size();
+            const size_t FIRST_NEW_VERTEX = geom.vertex_count();
+            if (BAKE)
+                geom.resize(FIRST_NEW_VERTEX + size_t(accumStrands) * STRAND_LENGTH, FIRST_NEW_STRAND + accumStrands);
+            else
             {
-                // Uniformize number
-                float pdf = areas[t] / totalArea;
-                const unsigned int STRANDS_TO_GROW = totalStrands * pdf;
-
-                for (size_t s = 0; s < STRANDS_TO_GROW; s++)
-                {
-
-                    // Get random value
-                    glm::vec2 sample2D = glm::vec2(dis(gen), dis(gen));
-                    glm::vec3 root = samplePoint(sample2D, vertices[indices[i]].position, vertices[indices[i + 1]].position, vertices[indices[i + 2]].position);
-
-                    // Check nearest Neighbors
-                    std::vector<Neighbor> nearestNeighbors;
-
-                    // Neighbor adjacency list;
-                    std::vector<Neighbor> roots;
-                    roots.reserve(rootsIndices.size());
-
-                    for (size_t r = 0; r < rootsIndices.size(); r++)
-                    {
-                        float dist = glm::distance(geom.vertices[rootsIndices[r]].position, root);
-                        Neighbor potentialN{rootsIndices[r], dist};
-                        roots.push_back(potentialN);
-                    }
-
-                    // Sort from closest to farthest
-                    std::sort(roots.begin(), roots.end(), [](const Neighbor &a, const Neighbor &b)
-                              { return a.dist < b.dist; });
-
-                    int count = 0;
-                    for (auto it = roots.begin(); it != roots.end() && count < NeighborS; ++it, ++count)
-                    {
-                        nearestNeighbors.push_back(*it);
-                    }
+                options.children->strands.resize(accumStrands);
+                options.children->length = STRAND_LENGTH;
+                options.children->guideVertices = FIRST_NEW_VERTEX;
+            }
 
-                    // Compute Neighbor weights
-                    float totalWeight = 0;
+            // Grown strands are streamed in batches of this size
+            const size_t BATCH_STRANDS = 2048;
 
-                    // RANDON WEIGHT PER Neighbor
-                    for (size_t nn = 0; nn < NeighborS; nn++)
-                    {
-                        nearestNeighbors[nn].weight = 1 / (nearestNeighbors[nn].dist * nearestNeighbors[nn].dist);
-                        totalWeight += nearestNeighbors[nn].weight;
-                    }
-                    // // NORMALIZE WEIGHTS
-                    for (size_t nn = 0; nn < NeighborS; nn++)
+            for (size_t batch = 0; batch < accumStrands; batch += BATCH_STRANDS)
+            {
+                const size_t BATCH_END = std::min<size_t>(batch + BATCH_STRANDS, accumStrands);
+                utils::parallel_for_range(batch, BATCH_END, [&](size_t START, size_t END)
+                                          {
+                    for (size_t s = START; s < END; s++)
                     {
-                        nearestNeighbors[nn].weight = nearestNeighbors[nn].weight / totalWeight;
-                    }
+                        utils::CounterRNG rng(options.seed, 2 * s + 1);
+                        std::array<Neighbor, NEIGHBORS> &neighbors = nearestNeighbors[s];
+                        // Last growth step each neighbor contributes to
+                        unsigned int cuts[NEIGHBORS];
+                        std::fill_n(cuts, NEIGHBORS, STRAND_LENGTH - 1);
 
-                    // CHOOSE RANDOM COLOR FOR DEBUG
-                    // glm::vec3 color = {((float)rand()) / RAND_MAX, ((float)rand()) / RAND_MAX, ((float)rand()) / RAND_MAX};
-                    glm::vec3 color = {1.0f, 0.0f, 0.0f};
-
-                    // NEW STRAND
-                    for (size_t s = 0; s < accumStrands; s++)
-                    {
                         // CHOOSE RANDOM COLOR FOR DEBUG
-                        glm::vec3 color = {((float)rand()) / RAND_MAX, ((float)rand()) / RAND_MAX, ((float)rand()) / RAND_MAX};
+                        glm::vec3 color = {rng.next_float(), rng.next_float(), rng.next_float()};
 
-                        unsigned int currentIndex = geom.indices.back() + 1;
+                        const size_t FIRST = FIRST_NEW_VERTEX + s * STRAND_LENGTH;
+                        if (!BAKE)
+                        {
+                            ChildStrand &child = options.children->strands[s];
+                            child.root = roots[s];
+                            child.color = glm::packUnorm4x8(glm::vec4(color, 1.0f));
+                            for (size_t n = 0; n < NEIGHBORS; n++)
+                            {
+                                child.guides[n] = neighbors[n].id;
+                                child.weights[n] = neighbors[n].weight;
+                            }
+                            child.weights.w = 0.0f;
+                        }
+                        else
+                        {
+                            geom.strands.first[FIRST_NEW_STRAND + s] = FIRST;
+                            geom.strands.count[FIRST_NEW_STRAND + s] = STRAND_LENGTH;
+                            geom.colors[FIRST_NEW_STRAND + s] = color;
 
-                        // Add root
-                        geom.vertices.push_back({roots[s], {0.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f}, color});
-                        geom.indices.push_back(currentIndex);
-                        geom.indices.push_back(currentIndex + 1);
-                        currentIndex++;
+                            // Add root
+                            geom.positions[FIRST] = roots[s];
+                            geom.tangents[FIRST] = {0.0f, 1.0f, 0.0f};
+                        }
 
                         // Grow
                         for (size_t p = 1; p < STRAND_LENGTH; p++)
                         {
                             // Compute differentials
                             glm::vec3 avrDiff = glm::vec3(0.0f);
+                            glm::vec3 diffs[NEIGHBORS];
 
                             for (size_t n = 0; n < NEIGHBORS; n++)
                             {
-                                glm::vec3 diff = geom.vertices[nearestNeighbors[s][n].id + p].position - geom.vertices[nearestNeighbors[s][n].id + (p - 1)].position;
-
-                                // Check is this diff is way to big
-
-                                avrDiff += diff * nearestNeighbors[s][n].weight;
+                                diffs[n] = geom.positions[neighbors[n].id + p] - geom.positions[neighbors[n].id + (p - 1)];
+                                avrDiff += diffs[n] * neighbors[n].weight;
                             }
 
-                            geom.vertices.push_back({geom.vertices.back().position + avrDiff, {0.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f}, color});
+                            if (BAKE)
+                            {
+                                // Update predecessor FRAME
+                                geom.tangents[FIRST + p - 1] = glm::normalize(avrDiff);
+                                // Setup new FRAME
+                                geom.positions[FIRST + p] = geom.positions[FIRST + p - 1] + avrDiff;
+                                geom.tangents[FIRST + p] = {0.0f, 1.0f, 0.0f};
+                            }
 
-                            // Control index generation
-                            if (p < STRAND_LENGTH - 1)
+                            // Compare diffs, neighbors diverging from a random kept one stop contributing
+                            unsigned int checkID = rng.next_uint() % NEIGHBORS;
+                            if (neighbors[checkID].weight == 0.0f)
+                                continue;
+                            glm::vec3 cDiff = glm::normalize(diffs[checkID]);
+                            for (size_t n = 0; n < NEIGHBORS; n++)
                             {
-                                geom.indices.push_back(currentIndex);
-                                geom.indices.push_back(currentIndex + 1);
-                                currentIndex++;
+                                if (n == checkID)
+                                    continue;
+                                if (neighbors[n].weight == 0.0f)
+                                    continue;
+                                glm::vec3 diff = glm::normalize(diffs[n]);
+                                if (glm::dot(cDiff, diff) <= 0.0f)
+                                {
+                                    neighbors[n].weight = 0.0f;
+                                    cuts[n] = p;
+                                }
                             }
                         }
-                    }
-                }
+
+                        if (!BAKE)
+                        {
+                            ChildStrand &child = options.children->strands[s];
+                            child.cuts = 0;
+                            for (size_t n = 0; n < NEIGHBORS; n++)
+                                child.cuts |= cuts[n] << (ChildStrand::CUT_BITS * n);
+                        }
+                    } },
+                                          64);
+
+                if (BAKE && mesh->is_streaming())
+                    publish_batch(mesh, geom, FIRST_NEW_STRAND + batch, FIRST_NEW_STRAND + BATCH_END, decimationTolerance);
+            }
+
+            // Any prefix of a shuffled set is an even subset, so the density can be lowered at render time by
+            // just drawing fewer children. The stream after the scramble one drives the shuffle
+            if (!BAKE)
+            {
+                utils::CounterRNG rng(options.seed, 2 * accumStrands + 1);
+                for (size_t s = options.children->strands.size(); s > 1; s--)
+                    std::swap(options.children->strands[s - 1], options.children->strands[rng.next_uint() % s]);
             }
-#endif
         };
 
-        Geometry g;
-        g.vertices = vertices;
-        g.indices = indices;
-        augmentDensity(g, 40000);
-        mesh->set_geometry(g);
+        // Guide strands can be shown while the dense ones are being grown
+        if (mesh->is_streaming())
+            publish_batch(mesh, g, 0, g.strands.size(), decimationTolerance);
+        augmentDensity(g, AUGMENTED_STRANDS);
+        // Growth reads guides point by point, so they are only decimated now
+        decimate_strands(g, decimationTolerance);
+        publish_geometry(mesh, g, useCache, cachePath, cacheKey);
 
-        return;
+        return true;
     }
     catch (const std::exception &e)
     {
         std::cerr << "Caught tinyply exception: " << e.what() << std::endl;
     }
+    return false;
 }
 
-void hair_loaders::load_cy_hair(Mesh *const mesh, const char *fileName)
+bool hair_loaders::load_cy_hair(HairMesh *const mesh, const char *fileName, bool useCache, float decimationTolerance)
 {
 
 #define HAIR_FILE_SEGMENTS_BIT 1
@@ -494,13 +916,6 @@ void hair_loaders::load_cy_hair(Mesh *const mesh, const char *fileName)
 #define HAIR_FILE_COLORS_BIT 16
 #define HAIR_FILE_INFO_SIZE 88
 
-    unsigned short *segments;
-    float *points;
-    float *dirs;
-    float *thickness;
-    float *transparency;
-    float *colors;
-
     struct Header
     {
         char signature[4];        //!< This should be "HAIR"
@@ -516,233 +931,251 @@ void hair_loaders::load_cy_hair(Mesh *const mesh, const char *fileName)
         char info[HAIR_FILE_INFO_SIZE]; //!< information about the file
     };
 
-    Header header;
-
-    header.signature[0] = 'H';
-    header.signature[1] = 'A';
-    header.signature[2] = 'I';
-    header.signature[3] = 'R';
-    header.hair_count = 0;
-    header.point_count = 0;
-    header.arrays = 0; // no arrays
-    header.d_segments = 0;
-    header.d_thickness = 1.0f;
-    header.d_transparency = 0.0f;
-    header.d_color[0] = 1.0f;
-    header.d_color[1] = 1.0f;
-    header.d_color[2] = 1.0f;
-    memset(header.info, '\0', HAIR_FILE_INFO_SIZE);
-
-    FILE *fp;
-    fp = fopen(fileName, "rb");
-    if (fp == nullptr)
-        return;
+    try
+    {
+        // The file is parsed in place. Only the final vertex and strand arrays are allocated
+        utils::MappedFile file(fileName);
 
-    // read the header
-    size_t headread = fread(&header, sizeof(Header), 1, fp);
+        // The tag keeps entries of different loaders apart, the tolerance is the only tunable
+        hair_cache::Key cacheKey{};
+        const std::string cachePath = hair_cache::get_path(fileName);
+        if (useCache)
+        {
+            cacheKey = {utils::hash_bytes(file.data(), file.size()),
+                        utils::hash_bytes(&decimationTolerance, sizeof(decimationTolerance), std::hash<std::string>{}("cy_hair"))};
+            if (restore_from_cache(mesh, cachePath, cacheKey))
+                return true;
+        }
 
-    // Check if header is correctly read
-    if (headread < 1)
-        return;
+        if (file.size() < sizeof(Header))
+        {
+            ERR_LOG("Error reading header");
+            return false;
+        }
 
-    // Check if this is a hair file
-    if (strncmp(header.signature, "HAIR", 4) != 0)
-        return;
+        Header header;
+        memcpy(&header, file.data(), sizeof(Header));
 
-    // Read segments array
-    if (header.arrays & HAIR_FILE_SEGMENTS_BIT)
-    {
-        segments = new unsigned short[header.hair_count];
-        size_t readcount = fread(segments, sizeof(unsigned short), header.hair_count, fp);
-        if (readcount < header.hair_count)
+        // Check if this is a hair file
+        if (strncmp(header.signature, "HAIR", 4) != 0)
+            return false;
+
+        // Locate the arrays inside the mapping. They are stored back to back in this order
+        size_t offset = sizeof(Header);
+        const uint8_t *segmentsData = nullptr;
+        const uint8_t *pointsData = nullptr;
+
+        if (header.arrays & HAIR_FILE_SEGMENTS_BIT)
         {
-            std::cerr << "Error reading segments" << std::endl;
-            return;
+            segmentsData = file.data() + offset;
+            offset += sizeof(unsigned short) * header.hair_count;
         }
-    }
-
-    // Read points array
-    if (header.arrays & HAIR_FILE_POINTS_BIT)
-    {
-        points = new float[header.point_count * 3];
-        size_t readcount = fread(points, sizeof(float), header.point_count * 3, fp);
-        if (readcount < header.point_count * 3)
+        if (header.arrays & HAIR_FILE_POINTS_BIT)
         {
-            std::cerr << "Error reading points" << std::endl;
-            return;
+            pointsData = file.data() + offset;
+            offset += sizeof(float) * 3 * header.point_count;
+        }
+        if (header.arrays & HAIR_FILE_THICKNESS_BIT)
+            offset += sizeof(float) * header.point_count;
+        if (header.arrays & HAIR_FILE_TRANSPARENCY_BIT)
+            offset += sizeof(float) * header.point_count;
+        if (header.arrays & HAIR_FILE_COLORS_BIT)
+            offset += sizeof(float) * 3 * header.point_count;
+
+        if (offset > file.size())
+        {
+            ERR_LOG("Error reading hair arrays, file is truncated");
+            return false;
+        }
+        if (!pointsData)
+        {
+            ERR_LOG("Error reading points");
+            return false;
         }
-    }
 
-    // Read thickness array
-    if (header.arrays & HAIR_FILE_THICKNESS_BIT)
-    {
-        thickness = new float[header.point_count];
-        size_t readcount = fread(thickness, sizeof(float), header.point_count, fp);
-        if (readcount < header.point_count)
+        // Arrays are only 2-byte aligned after the segments block, so read through memcpy
+        auto getSegments = [&](size_t hair) -> unsigned int
         {
-            std::cerr << "Error reading thickness" << std::endl;
-            return;
+            if (!segmentsData)
+                return header.d_segments;
+            unsigned short s;
+            memcpy(&s, segmentsData + hair * sizeof(unsigned short), sizeof(unsigned short));
+            return s;
+        };
+        auto getPoint = [&](float *p, size_t point)
+        {
+            memcpy(p, pointsData + point * 3 * sizeof(float), 3 * sizeof(float));
+        };
+
+        // Prefix sum over the strand sizes gives every strand its first point in the file
+        std::vector<size_t> filePoints(header.hair_count);
+        size_t points = 0;
+        for (size_t hair = 0; hair < header.hair_count; hair++)
+        {
+            filePoints[hair] = points;
+            points += getSegments(hair) + 1;
         }
-    }
 
-    // Read thickness array
-    if (header.arrays & HAIR_FILE_TRANSPARENCY_BIT)
-    {
-        transparency = new float[header.point_count];
-        size_t readcount = fread(transparency, sizeof(float), header.point_count, fp);
-        if (readcount < header.point_count)
+        // Validate strand sizes against the header before trusting it for the allocation
+        if (points != header.point_count)
         {
-            std::cerr << "Error reading alpha" << std::endl;
-            return;
+            ERR_LOG("Error reading segments, strand sizes do not match point count");
+            return false;
         }
-    }
 
-    // Read colors array
-    if (header.arrays & HAIR_FILE_COLORS_BIT)
-    {
-        colors = new float[header.point_count * 3];
-        size_t readcount = fread(colors, sizeof(float), header.point_count * 3, fp);
-        if (readcount < header.point_count * 3)
+        // File order is arbitrary, strands are stored sorted along a Morton curve of their roots instead
+        std::vector<glm::vec3> roots(header.hair_count);
+        for (size_t hair = 0; hair < header.hair_count; hair++)
+            getPoint(&roots[hair][0], filePoints[hair]);
+        const std::vector<uint32_t> order = utils::morton_order(roots);
+
+        // A second prefix sum, in sorted order, gives every strand its first vertex, so strands can be
+        // processed independently. Debug colors are drawn here to keep the rand() sequence serial
+        HairGeometry g;
+        g.strands.resize(header.hair_count);
+        g.colors.resize(header.hair_count);
+        g.thickness.resize(header.hair_count, 1.0f);
+        size_t vertices = 0;
+        for (size_t hair = 0; hair < header.hair_count; hair++)
         {
-            std::cerr << "Error reading colors" << std::endl;
-            return;
+            g.strands.first[hair] = vertices;
+            g.strands.count[hair] = getSegments(order[hair]) + 1;
+            vertices += g.strands.count[hair];
+            g.colors[hair] = {((float)rand()) / RAND_MAX, ((float)rand()) / RAND_MAX, ((float)rand()) / RAND_MAX};
         }
-    }
 
-    fclose(fp);
+        auto computeDirection = [](float *d, float &d0len, float &d1len, float const *p0, float const *p1, float const *p2)
+        {
+            // line from p0 to p1
+            float d0[3];
+            d0[0] = p1[0] - p0[0];
+            d0[1] = p1[1] - p0[1];
+            d0[2] = p1[2] - p0[2];
+            float d0lensq = d0[0] * d0[0] + d0[1] * d0[1] + d0[2] * d0[2];
+            d0len = (d0lensq > 0) ? (float)sqrt(d0lensq) : 1.0f;
+
+            // line from p1 to p2
+            float d1[3];
+            d1[0] = p2[0] - p1[0];
+            d1[1] = p2[1] - p1[1];
+            d1[2] = p2[2] - p1[2];
+            float d1lensq = d1[0] * d1[0] + d1[1] * d1[1] + d1[2] * d1[2];
+            d1len = (d1lensq > 0) ? (float)sqrt(d1lensq) : 1.0f;
+
+            // make sure that d0 and d1 has the same length
+            d0[0] *= d1len / d0len;
+            d0[1] *= d1len / d0len;
+            d0[2] *= d1len / d0len;
+
+            // direction at p1
+            d[0] = d0[0] + d1[0];
+            d[1] = d0[1] + d1[1];
+            d[2] = d0[2] + d1[2];
+            float dlensq = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+            float dlen = (dlensq > 0) ? (float)sqrt(dlensq) : 1.0f;
+            d[0] /= dlen;
+            d[1] /= dlen;
+            d[2] /= dlen;
+        };
 
-    auto computeDirection = [](float *d, float &d0len, float &d1len, float const *p0, float const *p1, float const *p2)
-    {
-        // line from p0 to p1
-        float d0[3];
-        d0[0] = p1[0] - p0[0];
-        d0[1] = p1[1] - p0[1];
-        d0[2] = p1[2] - p0[2];
-        float d0lensq = d0[0] * d0[0] + d0[1] * d0[1] + d0[2] * d0[2];
-        d0len = (d0lensq > 0) ? (float)sqrt(d0lensq) : 1.0f;
-
-        // line from p1 to p2
-        float d1[3];
-        d1[0] = p2[0] - p1[0];
-        d1[1] = p2[1] - p1[1];
-        d1[2] = p2[2] - p1[2];
-        float d1lensq = d1[0] * d1[0] + d1[1] * d1[1] + d1[2] * d1[2];
-        d1len = (d1lensq > 0) ? (float)sqrt(d1lensq) : 1.0f;
-
-        // make sure that d0 and d1 has the same length
-        d0[0] *= d1len / d0len;
-        d0[1] *= d1len / d0len;
-        d0[2] *= d1len / d0len;
-
-        // direction at p1
-        d[0] = d0[0] + d1[0];
-        d[1] = d0[1] + d1[1];
-        d[2] = d0[2] + d1[2];
-        float dlensq = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
-        float dlen = (dlensq > 0) ? (float)sqrt(dlensq) : 1.0f;
-        d[0] /= dlen;
-        d[1] /= dlen;
-        d[2] /= dlen;
-
-        // return d0len;
-    };
+        // Writes the vertices of one strand, starting at vertex p from file point filePoint, with their tangents
+        auto fillStrand = [&](size_t p, size_t filePoint, unsigned int s)
+        {
+            for (size_t i = 0; i <= s; i++)
+            {
+                getPoint(&g.positions[p + i][0], filePoint + i);
+                g.tangents[p + i] = {0.0f, 0.0f, 0.0f};
+            }
 
-    auto fillDirectionArray = [=](float *dir)
-    {
-        if (dir == nullptr || header.point_count <= 0 || points == nullptr)
-            return;
+            // Positions are already in place, tangents are derived from them
+            auto point = [&](size_t i) -> const float *
+            { return &g.positions[p + i][0]; };
+            auto setDir = [&](size_t i, const float *d)
+            { g.tangents[p + i] = {d[0], d[1], d[2]}; };
 
-        int p = 0; // point index
-        for (unsigned int i = 0; i < header.hair_count; i++)
-        {
-            int s = (segments) ? segments[i] : header.d_segments;
             if (s > 1)
             {
                 // direction at point1
+                float dir[3];
                 float len0, len1;
-                computeDirection(&dir[(p + 1) * 3], len0, len1, &points[p * 3], &points[(p + 1) * 3], &points[(p + 2) * 3]);
+                computeDirection(dir, len0, len1, point(0), point(1), point(2));
+                setDir(1, dir);
 
                 // direction at point0
                 float d0[3];
-                d0[0] = points[(p + 1) * 3] - dir[(p + 1) * 3] * len0 * 0.3333f - points[p * 3];
-                d0[1] = points[(p + 1) * 3 + 1] - dir[(p + 1) * 3 + 1] * len0 * 0.3333f - points[p * 3 + 1];
-                d0[2] = points[(p + 1) * 3 + 2] - dir[(p + 1) * 3 + 2] * len0 * 0.3333f - points[p * 3 + 2];
+                d0[0] = point(1)[0] - dir[0] * len0 * 0.3333f - point(0)[0];
+                d0[1] = point(1)[1] - dir[1] * len0 * 0.3333f - point(0)[1];
+                d0[2] = point(1)[2] - dir[2] * len0 * 0.3333f - point(0)[2];
                 float d0lensq = d0[0] * d0[0] + d0[1] * d0[1] + d0[2] * d0[2];
                 float d0len = (d0lensq > 0) ? (float)sqrt(d0lensq) : 1.0f;
-                dir[p * 3] = d0[0] / d0len;
-                dir[p * 3 + 1] = d0[1] / d0len;
-                dir[p * 3 + 2] = d0[2] / d0len;
-
-                // We computed the first 2 points
-                p += 2;
+                d0[0] /= d0len;
+                d0[1] /= d0len;
+                d0[2] /= d0len;
+                setDir(0, d0);
 
                 // Compute the direction for the rest
-                for (int t = 2; t < s; t++, p++)
+                for (unsigned int t = 2; t < s; t++)
                 {
-                    computeDirection(&dir[p * 3], len0, len1, &points[(p - 1) * 3], &points[p * 3], &points[(p + 1) * 3]);
+                    computeDirection(dir, len0, len1, point(t - 1), point(t), point(t + 1));
+                    setDir(t, dir);
                 }
 
                 // direction at the last point
-                d0[0] = -points[(p - 1) * 3] + dir[(p - 1) * 3] * len1 * 0.3333f + points[p * 3];
-                d0[1] = -points[(p - 1) * 3 + 1] + dir[(p - 1) * 3 + 1] * len1 * 0.3333f + points[p * 3 + 1];
-                d0[2] = -points[(p - 1) * 3 + 2] + dir[(p - 1) * 3 + 2] * len1 * 0.3333f + points[p * 3 + 2];
+                d0[0] = -point(s - 1)[0] + dir[0] * len1 * 0.3333f + point(s)[0];
+                d0[1] = -point(s - 1)[1] + dir[1] * len1 * 0.3333f + point(s)[1];
+                d0[2] = -point(s - 1)[2] + dir[2] * len1 * 0.3333f + point(s)[2];
                 d0lensq = d0[0] * d0[0] + d0[1] * d0[1] + d0[2] * d0[2];
                 d0len = (d0lensq > 0) ? (float)sqrt(d0lensq) : 1.0f;
-                dir[p * 3] = d0[0] / d0len;
-                dir[p * 3 + 1] = d0[1] / d0len;
-                dir[p * 3 + 2] = d0[2] / d0len;
-                p++;
+                d0[0] /= d0len;
+                d0[1] /= d0len;
+                d0[2] /= d0len;
+                setDir(s, d0);
             }
             else if (s > 0)
             {
                 // if it has a single segment
                 float d0[3];
-                d0[0] = points[(p + 1) * 3] - points[p * 3];
-                d0[1] = points[(p + 1) * 3 + 1] - points[p * 3 + 1];
-                d0[2] = points[(p + 1) * 3 + 2] - points[p * 3 + 2];
+                d0[0] = point(1)[0] - point(0)[0];
+                d0[1] = point(1)[1] - point(0)[1];
+                d0[2] = point(1)[2] - point(0)[2];
                 float d0lensq = d0[0] * d0[0] + d0[1] * d0[1] + d0[2] * d0[2];
                 float d0len = (d0lensq > 0) ? (float)sqrt(d0lensq) : 1.0f;
-                dir[p * 3] = d0[0] / d0len;
-                dir[p * 3 + 1] = d0[1] / d0len;
-                dir[p * 3 + 2] = d0[2] / d0len;
-                dir[(p + 1) * 3] = dir[p * 3];
-                dir[(p + 1) * 3 + 1] = dir[p * 3 + 1];
-                dir[(p + 1) * 3 + 2] = dir[p * 3 + 2];
-                p += 2;
+                d0[0] /= d0len;
+                d0[1] /= d0len;
+                d0[2] /= d0len;
+                setDir(0, d0);
+                setDir(1, d0);
             }
-            //*/
-        }
-    };
+        };
 
-    dirs = new float[header.point_count * 3];
-    fillDirectionArray(dirs);
+        // Single allocation for each final array, strands are filled in parallel straight into them
+        g.positions.resize(header.point_count);
+        g.tangents.resize(header.point_count);
 
-    std::vector<Vertex> vertices;
-    vertices.reserve(header.point_count * 3);
-    std::vector<unsigned int> indices;
+        // Strands are processed in batches, so finished ones can be streamed while the rest are processed
+        const size_t BATCH_STRANDS = 4096;
+        const size_t NUM_BATCHES = (header.hair_count + BATCH_STRANDS - 1) / BATCH_STRANDS;
 
-    size_t index = 0;
-    size_t pointId = 0;
-    for (size_t hair = 0; hair < header.hair_count; hair++)
+        // Batches are filled in any order but queued in order, so the GPU holds the strands sorted as well
+        OrderedBatchPublisher publisher(mesh, NUM_BATCHES);
+        utils::parallel_for(0, NUM_BATCHES, [&](size_t b)
+                            {
+            const size_t START_STRAND = BATCH_STRANDS * b;
+            const size_t END_STRAND = std::min<size_t>(BATCH_STRANDS * (b + 1), header.hair_count);
+            for (size_t hair = START_STRAND; hair < END_STRAND; hair++)
+                fillStrand(g.strands.first[hair], filePoints[order[hair]], g.strands.count[hair] - 1);
+
+            if (mesh->is_streaming())
+                publisher.publish(b, make_batch(g, START_STRAND, END_STRAND, decimationTolerance)); },
+                            1);
+
+        decimate_strands(g, decimationTolerance);
+        publish_geometry(mesh, g, useCache, cachePath, cacheKey);
+        return true;
+    }
+    catch (const std::exception &e)
     {
-        glm::vec3 color = {((float)rand()) / RAND_MAX, ((float)rand()) / RAND_MAX, ((float)rand()) / RAND_MAX};
-        size_t max_segments = segments ? segments[hair] : header.d_segments;
-        for (size_t i = 0; i < max_segments; i++)
-        {
-            vertices.push_back({{points[pointId], points[pointId + 1], points[pointId + 2]}, {0.0f, 0.0f, 0.0f}, {dirs[pointId], dirs[pointId + 1], dirs[pointId + 2]}, {0.0f, 0.0f}, color});
-            indices.push_back(index);
-            indices.push_back(index + 1);
-            index++;
-            pointId += 3;
-        }
-        vertices.push_back({{points[pointId], points[pointId + 1], points[pointId + 2]}, {0.0f, 0.0f, 0.0f}, {dirs[pointId], dirs[pointId + 1], dirs[pointId + 2]}, {0.0f, 0.0f}, color});
-        pointId += 3;
-        index++;
+        ERR_LOG("Caught hair loading exception: " << e.what());
     }
-
-    Geometry g;
-    g.vertices = vertices;
-    g.indices = indices;
-    mesh->set_geometry(g);
-    mesh->setup_bounding_volume();
+    return false;
 }
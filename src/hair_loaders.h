@@ -1,15 +1,95 @@
 #ifndef __HAIR_LOADERS__
 #define __HAIR_LOADERS__
 
+#include <array>
+#include <limits>
+#include <numeric>
+#include <glm/gtc/packing.hpp>
 #include "engine/loaders.h"
+#include "engine/hair_mesh.h"
+#include "hair_cache.h"
 
 USING_NAMESPACE_GLIB
 
 namespace hair_loaders
 {
-    void load_neural_hair(Mesh *const mesh, const char *fileName, Mesh *const skullMesh, bool preload = true, bool verbose = false, bool calculateTangents = false);
+    /*
+    Placement of the strand roots grown over the scalp
+    */
+    enum class RootSampling
+    {
+        RANDOM, // Independent uniform samples
+        SOBOL   // Scrambled Sobol points, evenly spread over the scalp
+    };
 
-    void load_cy_hair(Mesh *const mesh, const char *fileName);
+    /*
+    Strand interpolated at render time from three guide strands. Matches the std430 layout read by
+    resources/shaders/include/strand-interpolation.glsl.
+    */
+    struct ChildStrand
+    {
+        static constexpr unsigned int CUT_BITS = 10;
+        static constexpr unsigned int MAX_LENGTH = (1u << CUT_BITS) - 1;
+
+        glm::vec3 root;
+        uint32_t color;     // RGBA8
+        uint32_t guides[3]; // First vertex of each guide
+        uint32_t cuts;      // Last growth step every guide contributes to, CUT_BITS each
+        glm::vec4 weights;  // Guide weights in xyz
+    };
+    static_assert(sizeof(ChildStrand) == 48, "ChildStrand must match its std430 layout");
+
+    struct ChildStrands
+    {
+        std::vector<ChildStrand> strands; // Shuffled, so any prefix is an even subset of the whole set
+        unsigned int length{0};           // Vertices per child strand
+        size_t guideVertices{0};          // Guide vertices the children are interpolated from
+    };
+
+    struct NeuralHairOptions
+    {
+        bool preload = true;              // Read the whole file upfront when tinyply parses it
+        bool verbose = false;             // Log progress and timings
+        bool useCache = true;             // Reuse the processed result stored next to the source file
+        uint64_t seed = 0;                // Density augmentation seed
+        RootSampling sampling = RootSampling::RANDOM;
+        ChildStrands *children = nullptr; // Receives grown strands as interpolation records instead of baking them
+        size_t readChunkBytes = loaders::PLYStreamReader::DEFAULT_CHUNK_BYTES;
+        float decimationTolerance = 0.0f;
+    };
+
+    /*
+    Both loaders run on worker threads. If the mesh is in streaming mode, strands are queued on it in
+    batches as soon as they are processed instead of being set all at once at the end. They return false if the file
+    could not be loaded, which streaming meshes cannot tell from their own state until every batch is uploaded.
+
+    With useCache, the processed result is stored next to the source file and reused on later runs
+    as long as the source file, the skull mesh and the processing parameters stay the same.
+
+    Grown strands are fully determined by seed and sampling, whatever the number of threads.
+
+    Roots are sampled from the skull mesh geometry, so it has to keep its CPU copy (GeometryResidency::KEEP). The area
+    weighted table they are drawn from is built once per skull mesh and reused until its geometry changes.
+
+    If children is given, grown strands are not baked into the mesh, which then only holds the guides. Their
+    interpolation records are written to children instead, to be rebuilt on the GPU. The cache is not used then.
+
+    Binary groom files are read readChunkBytes at a time, which bounds the memory used on top of the strands.
+
+    Strands are decimated with decimationTolerance (see decimate_strands()) once grown. Guides are kept whole when
+    children are given, as children are interpolated from guides with a fixed number of points.
+    */
+    bool load_neural_hair(HairMesh *const mesh, const char *fileName, const Mesh *const skullMesh, const NeuralHairOptions &options = {});
+
+    bool load_cy_hair(HairMesh *const mesh, const char *fileName, bool useCache = true, float decimationTolerance = 0.0f);
+
+    /*
+    Resamples every strand to the fewest of its points that keep the dropped ones within tolerance (in model units)
+    of the resulting polyline (Douglas-Peucker), strands in parallel. Roots and tips are always kept and tangents
+    are recomputed. Strands are simplified independently, so a batch decimates the same as the whole geometry.
+    A tolerance of 0 leaves g untouched.
+    */
+    void decimate_strands(HairGeometry &g, float tolerance);
 }
 
 #endif
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "hair_renderer.h"
+#include <cmath>
 
 //----------------------------------------------
 // Hair model type
@@ -34,17 +35,22 @@ void HairRenderer::init()
     m_vignette = Mesh::create_screen_quad();
     m_skybox = Mesh::create_cube();
 
-    m_hair = new Mesh();
+    // Only the GPU copy of hair and floor is needed once uploaded. The head stays, hair roots are sampled from it
+    m_hair = new HairMesh();
+    m_hair->set_geometry_residency(GeometryResidency::RELEASE_AFTER_UPLOAD);
     m_head = new Mesh();
 
     m_floor = new Mesh();
-    loaders::load_OBJ(m_floor, "resources/models/plane.obj");
+    m_floor->set_geometry_residency(GeometryResidency::RELEASE_AFTER_UPLOAD);
+    m_loader.load_mesh(m_floor, "Floor", [](Mesh *const mesh)
+                       { return loaders::load_OBJ(mesh, "resources/models/plane.obj"); });
     m_floor->set_scale(50.0f);
     m_floor->set_position({0.0f, -4.0f, 0.0f});
 
     m_light.light = new PointLight();
     m_light.dummy = new Mesh();
-    loaders::load_OBJ(m_light.dummy, "resources/models/sphere.obj");
+    m_loader.load_mesh(m_light.dummy, "Light", [](Mesh *const mesh)
+                       { return loaders::load_OBJ(mesh, "resources/models/sphere.obj"); });
     m_light.set_position({6.0f, 3.0f, -6.0f});
 
 #pragma endregion
@@ -277,10 +283,16 @@ void HairRenderer::init()
     m_globalUBO = new UniformBuffer(sizeof(GlobalUniforms), UBOLayout::GLOBAL_LAYOUT);
     m_globalUBO->generate();
 
+    const size_t alignment = UniformBuffer::get_offset_alignment();
+    m_objectStride = (sizeof(ObjectUniforms) + alignment - 1) / alignment * alignment;
+    m_objectUBO = new UniformBuffer(m_objectStride * ObjectSlot::OBJECT_SLOTS, UBOLayout::OBJECT_LAYOUT);
+    m_objectUBO->generate();
+
     GraphicPipeline litPipeline{};
     litPipeline.shader = new Shader("resources/shaders/cook-torrance.glsl", ShaderType::LIT);
     litPipeline.shader->set_uniform_block("Camera", UBOLayout::CAMERA_LAYOUT);
     litPipeline.shader->set_uniform_block("Scene", UBOLayout::GLOBAL_LAYOUT);
+    litPipeline.shader->set_uniform_block("Object", UBOLayout::OBJECT_LAYOUT);
 
     GraphicPipeline hairPipeline{};
 #ifdef MARSCHNER
@@ -298,10 +310,12 @@ void HairRenderer::init()
 #endif
     hairPipeline.shader->set_uniform_block("Camera", UBOLayout::CAMERA_LAYOUT);
     hairPipeline.shader->set_uniform_block("Scene", UBOLayout::GLOBAL_LAYOUT);
+    hairPipeline.shader->set_uniform_block("Object", UBOLayout::OBJECT_LAYOUT);
 
     GraphicPipeline unlitPipeline{};
     unlitPipeline.shader = new Shader("resources/shaders/unlit.glsl", ShaderType::UNLIT);
     unlitPipeline.shader->set_uniform_block("Camera", UBOLayout::CAMERA_LAYOUT);
+    unlitPipeline.shader->set_uniform_block("Object", UBOLayout::OBJECT_LAYOUT);
     Material *lightMaterial = new Material(unlitPipeline);
     m_light.dummy->set_material(lightMaterial);
 
@@ -340,8 +354,7 @@ void HairRenderer::init()
     Material *headMaterial = new Material(litPipeline);
     headMaterial->set_texture("u_shadowMap", m_shadowFBO->get_attachments().front().texture);
     Texture *skin = new Texture();
-    loaders::load_image(skin, "resources/images/head.png");
-    skin->generate();
+    m_loader.load_texture(skin, "resources/images/head.png");
     headMaterial->set_texture("u_albedoMap", skin, 1);
     // headMaterial->set_texture("u_depthMap", m_depthFBO->get_attachments().front().texture, 2);
     m_head->set_material(headMaterial);
@@ -369,15 +382,18 @@ void HairRenderer::init()
     skymapConfig.wrapR = GL_CLAMP_TO_EDGE;
 
     Texture *skymap = new Texture({2048, 2048}, skymapConfig);
-    loaders::load_image(skymap, "resources/images/room.hdr", true);
-    skymap->generate();
     skyboxMaterial->set_texture("u_skymap", skymap);
 
     m_skybox->set_material(skyboxMaterial);
 
-    Texture *irradianceTexture = skymap->compute_irradiance(32);
-    headMaterial->set_texture("u_irradianceMap", irradianceTexture, 2);
-    hairMaterial->set_texture("u_irradianceMap", irradianceTexture, 3);
+    // Irradiance can only be computed once the enviroment is on the GPU
+    m_loader.load_texture(skymap, "resources/images/room.hdr", true, [=](bool loaded)
+                          {
+        if (!loaded)
+            return;
+        Texture *irradianceTexture = skymap->compute_irradiance(32);
+        headMaterial->set_texture("u_irradianceMap", irradianceTexture, 2);
+        hairMaterial->set_texture("u_irradianceMap", irradianceTexture, 3); });
 
 #ifndef EPIC
     TextureConfig lutConfig{};
@@ -391,13 +407,11 @@ void HairRenderer::init()
 
     // Marschner M term
     Texture *marschnerM = new Texture(lutConfig);
-    loaders::load_image(marschnerM, "resources/images/m.png");
-    marschnerM->generate();
+    m_loader.load_texture(marschnerM, "resources/images/m.png");
     hairMaterial->set_texture("u_m", marschnerM, 4);
     // Marschner N term
     Texture *marschnerN = new Texture(lutConfig);
-    loaders::load_image(marschnerN, "resources/images/sqn.png");
-    marschnerN->generate();
+    m_loader.load_texture(marschnerN, "resources/images/sqn.png");
     hairMaterial->set_texture("u_n", marschnerN, 5);
 #endif
 
@@ -405,15 +419,19 @@ void HairRenderer::init()
 
 #pragma region MESH LOADING
 
+    if (m_hairSettings.streaming)
+        m_hair->enable_streaming(m_hairSettings.uploadBudgetKB * 1024);
+
 #ifdef YUKSEL
     // CEM YUKSEL MODELS
     {
-        std::thread loadThread1(loaders::load_PLY, m_head, "resources/models/woman.ply", true, true, false);
-        loadThread1.detach();
+        m_loader.load_mesh(m_head, "Head", [](Mesh *const mesh)
+                           { return loaders::load_PLY(mesh, "resources/models/woman.ply", true, true, false); });
         m_head->set_rotation({180.0f, -90.0f, 0.0f});
         m_head->set_scale(0.98f);
-        std::thread loadThread2(hair_loaders::load_cy_hair, m_hair, "resources/models/straight.hair");
-        loadThread2.detach();
+        const float decimationTolerance = m_hairSettings.decimationTolerance;
+        m_loader.load_hair(m_hair, "Hair", [decimationTolerance](HairMesh *const mesh)
+                           { return hair_loaders::load_cy_hair(mesh, "resources/models/straight.hair", true, decimationTolerance); });
 
         // Low poly
         // m_hair->set_scale(0.054f);
@@ -427,9 +445,37 @@ void HairRenderer::init()
 #else
     // NEURAL HAIRCUT MODELS
     {
-        loaders::load_PLY(m_head, "resources/models/head_blender.ply", true, true, false);
-        std::thread loadThread1(hair_loaders::load_neural_hair, m_hair, "resources/models/2000000.ply", m_head, true, true, false);
-        loadThread1.detach();
+        // Hair roots are sampled from the head, so hair loading waits for it
+        m_loader.load_mesh(m_head, "Head", [](Mesh *const mesh)
+                           { return loaders::load_PLY(mesh, "resources/models/head_blender.ply", true, true, false); },
+                           [this](bool loaded)
+                           {
+            if (!loaded)
+                return;
+            Mesh *head = m_head;
+            // Augmented strands are either baked into the mesh or kept as interpolation records for the GPU
+            std::shared_ptr<hair_loaders::ChildStrands> children;
+            if (m_hairSettings.interpolateChildren)
+                children = std::make_shared<hair_loaders::ChildStrands>();
+            hair_loaders::NeuralHairOptions options;
+            options.verbose = true;
+            options.seed = m_hairSettings.seed;
+            options.sampling = m_hairSettings.sobolRoots ? hair_loaders::RootSampling::SOBOL : hair_loaders::RootSampling::RANDOM;
+            options.children = children.get();
+            options.readChunkBytes = size_t(m_hairSettings.readChunkMB) << 20;
+            options.decimationTolerance = m_hairSettings.decimationTolerance;
+            // children is captured too, options only points to it
+            m_loader.load_hair(m_hair, "Hair", [head, children, options](HairMesh *const mesh)
+                               { return hair_loaders::load_neural_hair(mesh, "resources/models/2000000.ply", head, options); },
+                               [this, children](bool loaded)
+                               {
+                if (!loaded || !children || children->strands.empty())
+                    return;
+                m_childStrands.buffer = new StorageBuffer(children->strands.size() * sizeof(hair_loaders::ChildStrand), SSBOLayout::CHILD_STRANDS_LAYOUT);
+                m_childStrands.buffer->generate(children->strands.data());
+                m_childStrands.count = children->strands.size();
+                m_childStrands.length = children->length;
+                m_childStrands.guideVertices = children->guideVertices; }); });
         m_head->set_scale(3.0);
         m_hair->set_scale(3.0);
     }
@@ -437,7 +483,15 @@ void HairRenderer::init()
 
 #ifdef TEST
 
-    m_hair = Mesh::create_strand();
+    // Single vertical strand
+    HairGeometry strand;
+    strand.resize(2, 1);
+    strand.positions = {{0.0f, 7.0f, 0.0f}, {0.0f, -7.0f, 0.0f}};
+    strand.tangents = {{0.0f, -1.0f, 0.0f}, {0.0f, -1.0f, 0.0f}};
+    strand.strands.first[0] = 0;
+    strand.strands.count[0] = 2;
+    m_hair = new HairMesh();
+    m_hair->set_geometry(std::move(strand));
     m_hair->generate_buffers();
     m_hair->set_material(hairMaterial);
 #endif
@@ -463,6 +517,12 @@ void HairRenderer::update()
         m_light.light->set_position({_x, m_light.light->get_position().y, _z});
         m_light.dummy->set_position(m_light.light->get_position());
     }
+
+    if (m_hair->is_streaming())
+        m_hair->upload_streamed_batches();
+    // Streaming may have reallocated them
+    m_hair->bind_strand_storage(SSBOLayout::STRAND_ATTRIBUTES_LAYOUT);
+    m_hair->bind_vertex_storage(SSBOLayout::STRAND_VERTICES_LAYOUT);
 }
 
 void HairRenderer::draw()
@@ -477,6 +537,9 @@ void HairRenderer::draw()
     camu.exposure = m_globalSettings.exposure;
     m_cameraUBO->cache_data(sizeof(CameraUniforms), &camu);
 
+    update_object_uniforms(ObjectSlot::HEAD_OBJECT, m_head);
+    update_object_uniforms(ObjectSlot::HAIR_OBJECT, m_hair);
+
     GlobalUniforms globu;
     globu.ambient = {m_globalSettings.ambientColor,
                      m_globalSettings.ambientStrength};
@@ -521,13 +584,13 @@ void HairRenderer::forward_pass()
     // ----- Draw ----
 
     MaterialUniforms headu;
-    headu.mat4Types["u_model"] = m_head->get_model_matrix();
     headu.vec3Types["u_albedo"] = m_headSettings.skinColor;
     headu.boolTypes["u_hasAlbedoTex"] = m_headSettings.useAlbedoTexture;
     headu.boolTypes["u_useSkybox"] = m_globalSettings.useSkyboxIrradiance;
     m_head->get_material()->set_uniforms(headu);
 
 #ifndef TEST
+    bind_object_uniforms(ObjectSlot::HEAD_OBJECT);
     m_head->draw();
 #endif
 
@@ -562,24 +625,38 @@ void HairRenderer::forward_pass()
     hairu.vec3Types["u_spec2"] = m_hairSettings.specColor2;
     hairu.floatTypes["u_specPwr2"] = m_hairSettings.specPower2;
 #endif
-    hairu.floatTypes["u_thickness"] = m_hairSettings.thickness;
-    hairu.mat4Types["u_model"] = m_hair->get_model_matrix();
+    // Fewer strands are widened to cover as much of the screen
+    const float density = get_strand_density(0.0f);
+    const size_t guides = static_cast<size_t>(std::ceil(m_hair->get_strand_count() * density));
+    hairu.floatTypes["u_thickness"] = m_hairSettings.thickness / density;
+    hairu.boolTypes["u_interpolated"] = false;
     // hairu.vec3Types["u_camPos"] = m_camera->get_position();
     m_hair->get_material()->set_uniforms(hairu);
 
+    bind_object_uniforms(ObjectSlot::HAIR_OBJECT);
 #ifdef TEST
-    m_hair->draw(true);
+    m_hair->draw_strands(guides, true);
 #else
-    m_hair->draw(true, GL_LINES);
+    m_hair->draw_strands(guides, true, GL_TRIANGLE_STRIP);
+
+    if (const size_t children = bind_child_strands(density))
+    {
+        hairu.boolTypes["u_interpolated"] = true;
+        hairu.intTypes["u_strandLength"] = m_childStrands.length;
+        m_hair->get_material()->set_uniforms(hairu);
+        // Two triangles per segment
+        m_hair->draw_procedural(children * 6 * (m_childStrands.length - 1), true, GL_TRIANGLES);
+    }
 #endif
 
     MaterialUniforms dummyu;
     m_light.dummy->set_position(m_light.light->get_position());
-    dummyu.mat4Types["u_model"] = m_light.dummy->get_model_matrix();
     dummyu.boolTypes["u_useVertexColor"] = false;
     dummyu.vec3Types["u_baseColor"] = glm::vec3(1.0f);
     m_light.dummy->get_material()->set_uniforms(dummyu);
 
+    update_object_uniforms(ObjectSlot::LIGHT_OBJECT, m_light.dummy);
+    bind_object_uniforms(ObjectSlot::LIGHT_OBJECT);
     m_light.dummy->draw();
 
     // MaterialUniforms flooru;
@@ -608,15 +685,23 @@ void HairRenderer::depth_prepass()
     resize_viewport(m_window.extent);
 
     m_depthPipeline.shader->bind();
-    m_depthPipeline.shader->set_mat4("u_model", m_head->get_model_matrix());
+    bind_object_uniforms(ObjectSlot::HEAD_OBJECT);
     m_head->draw(false);
     m_depthPipeline.shader->unbind();
 
     m_strandDepthPipeline.shader->bind();
-    m_strandDepthPipeline.shader->set_mat4("u_model", m_hair->get_model_matrix());
-    m_strandDepthPipeline.shader->set_float("u_thickness", m_hairSettings.thickness);
+    bind_object_uniforms(ObjectSlot::HAIR_OBJECT);
+    const float density = get_strand_density(m_hairSettings.lodDepthBias);
+    m_strandDepthPipeline.shader->set_float("u_thickness", m_hairSettings.thickness / density);
     m_strandDepthPipeline.shader->set_vec3("u_camPos", m_camera->get_position());
-    m_hair->draw(false, GL_LINES);
+    m_strandDepthPipeline.shader->set_bool("u_interpolated", false);
+    m_hair->draw_strands(static_cast<size_t>(std::ceil(m_hair->get_strand_count() * density)), false, GL_TRIANGLE_STRIP);
+    if (const size_t children = bind_child_strands(density))
+    {
+        m_strandDepthPipeline.shader->set_bool("u_interpolated", true);
+        m_strandDepthPipeline.shader->set_int("u_strandLength", m_childStrands.length);
+        m_hair->draw_procedural(children * 6 * (m_childStrands.length - 1), false, GL_TRIANGLES);
+    }
     m_strandDepthPipeline.shader->unbind();
 }
 #pragma endregion
@@ -633,21 +718,95 @@ void HairRenderer::shadow_pass()
 
     m_shadowPipeline.shader->bind();
 
-    m_shadowPipeline.shader->set_mat4("u_model", m_head->get_model_matrix());
+    bind_object_uniforms(ObjectSlot::HEAD_OBJECT);
     m_shadowPipeline.shader->set_bool("u_isHair", false);
+    m_shadowPipeline.shader->set_bool("u_interpolated", false);
     m_head->draw(false);
 
     // m_depthPipeline.shader->set_mat4("u_model", m_floor->get_model_matrix());
     // m_floor->draw(false);
 
-    m_shadowPipeline.shader->set_mat4("u_model", m_hair->get_model_matrix());
+    bind_object_uniforms(ObjectSlot::HAIR_OBJECT);
     m_shadowPipeline.shader->set_bool("u_isHair", true);
 
-    m_hair->draw(false, GL_LINES);
+    // Shadows are plain lines, there is no width to widen for the strands left out. Unbiased they follow the density of
+    // the forward pass, a bias trades shadow coverage for speed
+    const float density = get_strand_density(m_hairSettings.lodShadowBias);
+    m_hair->draw_strands(static_cast<size_t>(std::ceil(m_hair->get_strand_count() * density)), false);
+    if (const size_t children = bind_child_strands(density))
+    {
+        m_shadowPipeline.shader->set_bool("u_interpolated", true);
+        m_shadowPipeline.shader->set_int("u_strandLength", m_childStrands.length);
+        // Shadows keep plain lines, one per segment
+        m_hair->draw_procedural(children * 2 * (m_childStrands.length - 1), false, GL_LINES);
+    }
 
     m_shadowPipeline.shader->unbind();
 }
 #pragma endregion
+#pragma region OBJECT UNIFORMS
+void HairRenderer::update_object_uniforms(ObjectSlot slot, Object3D *obj)
+{
+    // Model matrices are rebuilt only when the object is dirty, the inversions only when the result changed
+    const glm::mat4 model = obj->get_model_matrix();
+    const glm::mat4 view = m_camera->get_view();
+    ObjectSlotState &state = m_objectSlots[slot];
+    if (state.model == model && state.view == view)
+        return;
+    state.model = model;
+    state.view = view;
+
+    ObjectUniforms obju;
+    obju.model = model;
+    obju.modelView = view * model;
+    obju.normal = glm::transpose(glm::inverse(model));
+    obju.viewNormal = glm::transpose(glm::inverse(obju.modelView));
+    m_objectUBO->cache_data(sizeof(ObjectUniforms), &obju, slot * m_objectStride);
+}
+
+void HairRenderer::bind_object_uniforms(ObjectSlot slot)
+{
+    m_objectUBO->bind_range(slot * m_objectStride, sizeof(ObjectUniforms));
+}
+#pragma endregion
+#pragma region CHILD STRANDS
+size_t HairRenderer::bind_child_strands(float density)
+{
+    // Children index guide vertices, which arrive in batches when streaming
+    if (!m_childStrands.buffer || !m_hair->is_buffer_loaded() || m_hair->get_vertex_count() < m_childStrands.guideVertices)
+        return 0;
+
+    m_childStrands.buffer->bind();
+
+    // Children are shuffled, drawing a prefix keeps them evenly spread
+    return static_cast<size_t>(m_childStrands.count * glm::clamp(m_hairSettings.childDensity, 0.0f, 1.0f) * density);
+}
+#pragma endregion
+#pragma region STRAND LOD
+float HairRenderer::get_strand_density(float bias)
+{
+    if (!m_hairSettings.lod)
+        return 1.0f;
+
+    float density = 1.0f;
+    if (const Sphere *sphere = static_cast<Sphere *>(m_hair->get_bounding_volume()))
+    {
+        const glm::mat4 model = m_hair->get_model_matrix();
+        const glm::vec3 center = model * glm::vec4(sphere->center, 1.0f);
+        const float scale = glm::max(glm::length(glm::vec3(model[0])), glm::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+        const float radius = sphere->radius * scale;
+        const float distance = glm::length(center - m_camera->get_position());
+        // Inside the sphere the hair fills the screen
+        if (distance > radius)
+        {
+            // Projected diameter in pixels, the projection scales y by the cotangent of half the field of view
+            const float size = radius / std::sqrt(distance * distance - radius * radius) * m_camera->get_projection()[1][1] * m_window.extent.height;
+            density = glm::clamp(size / m_hairSettings.lodFullDetailSize, m_hairSettings.lodMinDensity, 1.0f);
+        }
+    }
+    return glm::clamp(density * std::exp2(-bias), 1e-3f, 1.0f);
+}
+#pragma endregion
 #pragma region NOISE PASS
 void HairRenderer::noise_pass()
 {
@@ -790,10 +949,29 @@ void HairRenderer::setup_user_interface_frame()
         set_v_sync(m_settings.vSync);
     }
     ImGui::DragFloat("Camera Exposure", &m_globalSettings.exposure);
+    if (!m_loader.is_idle())
+    {
+        ImGui::SeparatorText("Loading");
+        for (const AssetLoader::Handle &job : m_loader.get_jobs())
+            if (job->state != LoadState::READY)
+                ImGui::Text("%s: %s", job->name.c_str(), AssetLoader::get_state_name(job->state));
+    }
     ImGui::Separator();
     ImGui::SeparatorText("Hair Settings");
     gui::draw_transform_widget(m_hair);
     ImGui::DragFloat("Strand thickness", &m_hairSettings.thickness, 0.001f, 0.001f, 0.05f);
+    if (m_hair->is_streaming() && ImGui::DragInt("Upload budget (KB/frame)", &m_hairSettings.uploadBudgetKB, 64.0f, 64, 65536))
+        m_hair->set_stream_budget(m_hairSettings.uploadBudgetKB * 1024);
+    if (m_childStrands.buffer)
+        ImGui::SliderFloat("Interpolated density", &m_hairSettings.childDensity, 0.0f, 1.0f);
+    ImGui::Checkbox("Strand LOD", &m_hairSettings.lod);
+    if (m_hairSettings.lod)
+    {
+        ImGui::DragFloat("Full detail size (px)", &m_hairSettings.lodFullDetailSize, 10.0f, 1.0f, 8192.0f);
+        ImGui::SliderFloat("Min density", &m_hairSettings.lodMinDensity, 0.01f, 1.0f);
+        ImGui::DragFloat("Shadow LOD bias", &m_hairSettings.lodShadowBias, 0.05f, 0.0f, 8.0f);
+        ImGui::DragFloat("Depth LOD bias", &m_hairSettings.lodDepthBias, 0.05f, 0.0f, 8.0f);
+    }
 #ifdef MARSCHNER
     ImGui::ColorEdit3("Base color", (float *)&m_hairSettings.baseColor);
     ImGui::DragFloat("R Scale", &m_hairSettings.Rpower, .05f, 0.0f, 30.0f);
@@ -3,10 +3,10 @@
 
 #include <filesystem>
 #include <unistd.h>
-#include <thread>
 
 #include "engine/shader.h"
 #include "engine/mesh.h"
+#include "engine/hair_mesh.h"
 #include "engine/loaders.h"
 #include "engine/controller.h"
 #include "engine/camera.h"
@@ -30,7 +30,7 @@ private:
     Camera *m_camera;
     Controller *m_controller;
 
-    Mesh *m_hair;
+    HairMesh *m_hair;
     Mesh *m_head;
     Mesh *m_floor;
     Mesh* m_vignette;
@@ -77,9 +77,50 @@ private:
         glm::vec4 frustrumData;
     };
 
+    // Matrices shaders would otherwise rebuild per vertex, one block per drawn object in the same buffer
+    struct ObjectUniforms
+    {
+        glm::mat4 model;
+        glm::mat4 modelView;
+        glm::mat4 normal;     // transpose(inverse(model)), for world space normals
+        glm::mat4 viewNormal; // transpose(inverse(modelView)), for view space normals
+    };
+    enum ObjectSlot
+    {
+        HEAD_OBJECT = 0,
+        HAIR_OBJECT = 1,
+        LIGHT_OBJECT = 2,
+        OBJECT_SLOTS = 3
+    };
+    // What every slot was last filled from
+    struct ObjectSlotState
+    {
+        glm::mat4 model{0.0f};
+        glm::mat4 view{0.0f};
+    };
+
     UniformBuffer *m_cameraUBO;
     UniformBuffer *m_globalUBO;
     UniformBuffer *m_objectUBO;
+    size_t m_objectStride{0}; // Bytes between object blocks, aligned for binding
+    ObjectSlotState m_objectSlots[OBJECT_SLOTS];
+
+    enum SSBOLayout
+    {
+        STRAND_VERTICES_LAYOUT = 0,
+        CHILD_STRANDS_LAYOUT = 1,
+        STRAND_ATTRIBUTES_LAYOUT = 2
+    };
+    // Augmented strands interpolated from the guides at render time
+    struct ChildStrandData
+    {
+        StorageBuffer *buffer{nullptr};
+        size_t count{0};
+        unsigned int length{0};
+        size_t guideVertices{0};
+    };
+
+    ChildStrandData m_childStrands{};
 
     //--- Framebuffer and shading data ---
 
@@ -133,12 +174,34 @@ private:
 
     void shadow_pass();
 
+    /*
+    Refills the object block of slot if the model matrix of obj or the camera view changed since last time.
+    */
+    void update_object_uniforms(ObjectSlot slot, Object3D *obj);
+
+    /*
+    Binds the object block of slot for the next draws.
+    */
+    void bind_object_uniforms(ObjectSlot slot);
+
     void postprocess_pass();
 
     void smaa_pass();
 
     void noise_pass();
 
+    /*
+    Fraction of the strands a pass draws. Follows the projected size of the hair bounding sphere and is lowered
+    further by bias LOD levels, each one halving it.
+    */
+    float get_strand_density(float bias);
+
+    /*
+    Binds the buffer child strands are pulled from. Returns the number of child strands to draw at density, zero
+    until both the children and the guides they are interpolated from are on the GPU.
+    */
+    size_t bind_child_strands(float density = 1.0f);
+
 #pragma region INPUT
     void key_callback(GLFWwindow *w, int a, int b, int c, int d)
     {
@@ -13,6 +13,7 @@
 #include <stb_image_write.h>
 
 #include "gmath.hpp"
+#include "../engine/thread_pool.h"
 
 typedef unsigned int uint;
 using namespace math;
@@ -96,9 +97,11 @@ namespace LUTGen
         // matrix
         std::vector<std::vector<RGBA>> G(SIZE, std::vector<RGBA>(SIZE, {Color(0.0),0.0}));
 
-        // Fetch max terms
-        Color max{0.0};
-        for (size_t x = 0; x < SIZE; x++)
+        // Fetch max terms. Columns are computed in parallel, each one keeping its own max
+        std::vector<Color> columnMax(SIZE, Color(0.0));
+        glib::utils::parallel_for(0, SIZE, [&](size_t x)
+                                  {
+            Color &max = columnMax[x];
             for (size_t y = 0; y < SIZE; y++)
             {
                 double sin_thI = -1.0 + (x * 2.0) / SIZE;
@@ -126,7 +129,18 @@ namespace LUTGen
                     max.b = g.b;
 
                 G[x][y] = {g,cos(thD)};
-            }
+            } });
+
+        Color max{0.0};
+        for (const Color &m : columnMax)
+        {
+            if (m.r > max.r)
+                max.r = m.r;
+            if (m.g > max.g)
+                max.g = m.g;
+            if (m.b > max.b)
+                max.b = m.b;
+        }
 
 #ifdef DEBUG_MODE
         DEBUG_LOG("Longitudinal Term");
@@ -165,7 +179,9 @@ namespace LUTGen
         const uint TOTAL_SIZE = SIZE * SIZE * CHANNELS;
         std::vector<unsigned char> imageData(TOTAL_SIZE);
 
-        for (size_t x = 0; x < SIZE; x++)
+        // Every texel is independent
+        glib::utils::parallel_for(0, SIZE, [&](size_t x)
+                                  {
             for (size_t y = 0; y < SIZE; y++)
             {
                 double cos_phiD = -1.0 + (x * 2.0) / SIZE;
@@ -184,7 +200,7 @@ namespace LUTGen
                 imageData[linearID + 0] = static_cast<unsigned char>(n.r * 255.0);
                 imageData[linearID + 1] = static_cast<unsigned char>(n.g * 255.0);
                 imageData[linearID + 2] = static_cast<unsigned char>(n.b * 255.0);
-            }
+            } });
 
         stbi_write_png(filename, SIZE, SIZE, CHANNELS, imageData.data(), SIZE * CHANNELS);
 
@@ -15,6 +15,19 @@ struct UserInterfaceSettings
 struct HairSettings
 {
     float thickness = 0.002f;
+    bool streaming = true;   // Show strands while they are being loaded
+    int uploadBudgetKB = 4096; // Streamed data uploaded per frame
+    uint64_t seed = 0;         // Density augmentation seed
+    bool sobolRoots = false;   // Low discrepancy root placement for augmented strands
+    bool interpolateChildren = true; // Rebuild augmented strands from the guides on the GPU instead of baking them
+    float childDensity = 1.0f;       // Fraction of the interpolated strands drawn
+    int readChunkMB = 64;            // Memory the groom reader uses at once
+    float decimationTolerance = 0.0f; // Distance strand points may be simplified away by, in model units. 0 keeps them all
+    bool lod = true;                  // Draw fewer, wider strands as the hair gets smaller on screen
+    float lodFullDetailSize = 720.0f; // Screen height in pixels the hair has to span to draw every strand
+    float lodMinDensity = 0.1f;       // Fewest strands drawn, as a fraction
+    float lodShadowBias = 0.0f;       // Extra LOD levels of the shadow pass, each one halves its strands
+    float lodDepthBias = 0.0f;        // Extra LOD levels of the depth prepass
 #ifdef MARSCHNER
     glm::vec3 baseColor = glm::vec3(
         68.0f / 255.0f,